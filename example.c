@@ -33,7 +33,7 @@ int main(int argc, char* argv[])
 		/* set errno to 0 to check for errors reliably */
 		errno = 0;
 		/* match input with pattern, not saving the length (hence NULL) */
-		re_match(pattern, buffer, NULL);
+		re_matchp(&pattern, buffer, NULL);
 		if (!errno)
 			/* rmatch succeeded, so print out the line */
 			printf("%s", buffer);
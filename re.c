@@ -14,32 +14,364 @@
  */
 
 /*
- * In this library, unless explicitly stated otherwise, all functions return the number of characters eaten, and they report errors by setting errno and returning 0.
+ * In this library, unless explicitly stated otherwise, all functions return the number of characters eaten.
+ * The public and compilation functions report errors by setting errno and returning 0.
+ * The matching functions instead report failure by returning NOMATCH and never touch errno, as they sit in the innermost loops; only the public API sets errno.
  */
 
 #include "re.h"
 #include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef RE_USE_MALLOC
+#include <stdlib.h>
+#endif
+#ifdef RE_USE_PTHREADS
+#include <pthread.h>
+#endif
+#if defined(__GNUC__) && defined(__unix__)
+#include <sched.h>
+#endif
+#if defined(RE_NO_SIMD)
+/* portable code only */
+#elif defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#define RE_AVX2
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define RE_SSE2
+#elif defined(__GNUC__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RE_NEON
+#endif
+/* the classes of chars in chartypes */
+#define CT_DIGIT 0x1 /* \d */
+#define CT_SPACE 0x2 /* \s */
+#define CT_WORD  0x4 /* \w */
+#define CT_ALPHA 0x8 /* letters, which have an uppercase and a lowercase */
+
+#ifndef RE_USE_LOCALE
+/* the classes of each char in the "C" locale, so that matching doesn't depend on the locale or call out to ctype.h; chars from 0x80 up are in none */
+static const unsigned char chartypes[UCHAR_MAX+1] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, CT_SPACE, CT_SPACE, CT_SPACE, CT_SPACE, CT_SPACE, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	CT_SPACE, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	CT_DIGIT|CT_WORD, CT_DIGIT|CT_WORD, CT_DIGIT|CT_WORD, CT_DIGIT|CT_WORD, CT_DIGIT|CT_WORD, CT_DIGIT|CT_WORD, CT_DIGIT|CT_WORD, CT_DIGIT|CT_WORD,
+	CT_DIGIT|CT_WORD, CT_DIGIT|CT_WORD, 0, 0, 0, 0, 0, 0,
+	0, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA,
+	CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA,
+	CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA,
+	CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, 0, 0, 0, 0, CT_WORD,
+	0, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA,
+	CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA,
+	CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA,
+	CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, CT_WORD|CT_ALPHA, 0, 0, 0, 0, 0,
+};
+/* the lowercase of each char in the "C" locale */
+static const unsigned char lowercase[UCHAR_MAX+1] =
+{
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+	0x40, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+	0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+	0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+	0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+	0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+	0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff,
+};
+#endif
+
+/* chartype: returns whether c is in any of the classes in mask */
+static inline bool chartype(char c, unsigned mask)
+{
+	const unsigned char uc = c;
+#ifdef RE_USE_LOCALE
+	return ((mask & CT_DIGIT) && isdigit(uc)) || ((mask & CT_SPACE) && isspace(uc)) || ((mask & CT_WORD) && (isalnum(uc) || uc == '_')) || ((mask & CT_ALPHA) && tolower(uc) != toupper(uc));
+#else
+	return chartypes[uc] & mask;
+#endif
+}
+/* foldcase: returns the lowercase of c, which is what chars are compared by when case is ignored */
+static inline char foldcase(char c)
+{
+#ifdef RE_USE_LOCALE
+	return (char)tolower((unsigned char)c);
+#else
+	return (char)lowercase[(unsigned char)c];
+#endif
+}
 /* small useful function that I'm going to pretend is in ctype.h */
-static int iswordchar(int c)
+static inline bool iswordchar(char c)
+{
+	return chartype(c, CT_WORD);
+}
+/* iswordcharat: whether there is a word char at index i of text; indices outside of the text (including (size_t)-1) aren't */
+static bool iswordcharat(const char* text, size_t len, size_t i)
 {
-	return isalnum(c) || c == '_';
+	return i < len && iswordchar(text[i]);
 }
 
 /* TODO remove this sleep */
 #include <unistd.h>
 
-#define UNUSED(variable) (void)(variable)
+/* the format of the data written by re_serialize; bump it in the same change as any change to the layout or meaning of the fields of the Regex, */
+/* its tokens or its class chars, also when their sizes stay the same (sizeof(Regex) and sizeof(re_Token) are checked apart from it) */
+/* 1: the first format, to which maxlength and then required and its skip table were added without a bump; 2: rnfa; 3: minlength; */
+/* 4: 16-bit quantifiers; 5: sizeof(re_Token) in the header; 6: the automata after the class chars instead of in the Regex */
+#define SERIALVERSION 6
+/* what the data written by re_serialize is rounded up to, so that the next regex in a pack is aligned too */
+#define SERIALALIGN 8
+
+/* returned by the matching functions when they fail to match; it can't be a valid length or token index */
+#define NOMATCH SIZE_MAX
+/* the parent that the backtracker gives the tokens at the top level of a regex */
+#define NOPARENT UINT32_MAX
+
+/* number of steps between the checks of clock() against a deadline */
+#define CLOCKINTERVAL 1024
+/* number of steps per state that the backtracker may take when there is no room to remember which of them have failed */
+#define MEMOSTEPS 16
+/* number of regexes of a RegexSet whose DFAs setsearch runs side by side; a multiple of CHAR_BIT, so that each block starts a byte of matched */
+#define SETBLOCK 64
+/* number of times a thread tries to take a RegexCache before it lets other threads run in between */
+#define CACHESPINS 64
+
+/* DFA table entries that aren't states */
+#define DFA_MATCH UCHAR_MAX /* the regex has matched before this char */
+#define DFA_DEAD (UCHAR_MAX-1) /* the regex can't match any more */
+
+/* COUNT: adds n to a counter of the stats that budget counts the work in, if there are any; with RE_USE_STATS undefined, there is nothing to count */
+#ifdef RE_USE_STATS
+#define COUNT(budget, counter, n) do { if ((budget) && (budget)->stats) (budget)->stats->counter += (n); } while (0)
+#else
+#define COUNT(budget, counter, n) ((void)(budget))
+#endif
 
 /*
  * PRIVATE FUNCTION DECLARATIONS
  */
 
+/* state of a single call to re_compile; kept on its stack so that compilation is reentrant */
+typedef struct CompileState
+{
+	re_Token* tokens; /* where the tokens are stored, or NULL if they are only being counted */
+	size_t maxtokens; /* number of tokens that fit in tokens, including the terminating END */
+	ClassChar* cclbuf; /* where the class chars are stored, or NULL if they are only being counted */
+	size_t cclbuflen; /* number of class chars that fit in cclbuf */
+	size_t ccli; /* number of class chars so far */
+	size_t depth; /* number of open groups */
+} CompileState;
+
+/* a set of NFA instructions, used as the contents of a DFA state */
+typedef struct NfaSet
+{
+	unsigned char pcs[MAXNFA / CHAR_BIT]; /* bitmap of instruction indices */
+	bool atstart; /* whether the state is at the start of the text */
+	bool prevword; /* whether the char before the state is a word char */
+} NfaSet;
+
+/* a thread of the NFA simulation: a position in the program, and where the match it is trying started */
+typedef struct NfaThread
+{
+	size_t pc;
+	size_t start;
+} NfaThread;
+
+/* what the zero-width instructions can see at a position in the text */
+typedef struct NfaContext
+{
+	size_t i; /* the position */
+	bool atstart; /* whether it is the start of the text */
+	bool atend; /* whether it is the end of the text */
+	bool prevword; /* whether the char before it is a word char */
+	bool nextword; /* whether the char after it is a word char */
+} NfaContext;
+
+/* the threads at one position in the text, in order of priority */
+typedef struct NfaList
+{
+	size_t n;
+	NfaThread threads[MAXNFA];
+	size_t* slots; /* the capture slots of each thread, one after another */
+} NfaList;
+
+/* the limits on how much work a search may do, and how much it has done */
+typedef struct Budget
+{
+	size_t steps; /* steps taken so far */
+	size_t maxsteps; /* most steps that may be taken */
+	clock_t deadline; /* value of clock() at which the search gives up, or 0 if there is none */
+	size_t nextclock; /* number of steps at which clock() is checked next */
+	bool exceeded; /* whether the search gave up */
+	void* work; /* where the backtracker keeps its state, or NULL for a buffer of WORKLEN bytes on the stack */
+	size_t worklen; /* number of bytes of work */
+	bool full; /* whether the search gave up because the backtracker ran out of work space */
+#ifdef RE_USE_STATS
+	re_stats* stats; /* where the work is counted, or NULL */
+#endif
+} Budget;
+
+/* the states from which the rest of a regex (or of the lookaround or atomic group they are in) is known to fail, so that the backtracker doesn't try them again */
+typedef struct Memo
+{
+	unsigned char* bits; /* per position in the text, one bit per state, or NULL if there is no room for them */
+	size_t stride; /* number of bytes per position */
+	size_t lo; /* the bits of the positions from lo up to hi have been cleared */
+	size_t hi;
+} Memo;
+
+/* the kinds of records on the trail of the backtracker: the choices that it can go back to, and what it has to undo on the way there */
+typedef enum TrailKind
+{
+	TRAIL_COUNT, /* undo: the group or \R at pi had been repeated a times, and the repetition being matched started at b */
+	TRAIL_SPAN, /* undo: the capturing group at pi had captured b chars from a */
+	TRAIL_MEMO, /* once popped, the rest of the frame it is in is known to fail from state b of token pi at a */
+	TRAIL_FRAME, /* the lookaround or atomic token at pi started at a, where a lookbehind also has to end; b is the index of the frame around it, or NOMATCH */
+	TRAIL_BEHIND, /* choice: the lookbehind of the frame below started its tokens at a, and can start them at any index down to b + 1 instead */
+	TRAIL_RUN, /* choice: the greedy run of token pi ended at b, and can end anywhere down to a instead */
+	TRAIL_LAZYRUN, /* choice: the lazy run of token pi ended at a, and can end anywhere up to b instead */
+	TRAIL_EXIT, /* choice: the greedy group or \R at pi was repeated again at a, and can stop there instead */
+	TRAIL_REPEAT, /* choice: the lazy group or \R at pi stopped at a, and can be repeated again there instead */
+	TRAIL_COUNTED = 0x100 /* flag of EXIT and REPEAT: the repetition that had just ended is undone with them, back to one less of them started at b */
+} TrailKind;
+
+/* a record on the trail of the backtracker */
+typedef struct Trail
+{
+	uint32_t kind; /* TrailKind */
+	uint32_t pi; /* index of the token it is about */
+	size_t a;
+	size_t b;
+} Trail;
+
+/* what the backtracker does next */
+typedef enum Step
+{
+	STEP_TOKEN, /* match token pi at i */
+	STEP_LOOP, /* the group or \R at pi has been repeated up to i; repeat it again or stop */
+	STEP_REPEAT, /* repeat the group or \R at pi from i */
+	STEP_EXIT, /* stop repeating the group or \R at pi, at i */
+	STEP_NEXT, /* token pi has matched up to i; go on with the one after it */
+	STEP_FAIL /* go back to the last choice on the trail */
+} Step;
+
+/* the state of the backtracker during a search, all of it in its work space */
+typedef struct Backtracker
+{
+	const Regex* pattern;
+	const char* text;
+	size_t len;
+	Budget* budget;
+	Memo memo;
+	bool capturing; /* whether it keeps spans */
+	size_t* counts; /* per group or \R token, the number of times it has been repeated */
+	size_t* starts; /* likewise, where the repetition being matched started */
+	size_t* bases; /* per token, the first of its states; they are numbered from 0 up to nstates */
+	uint32_t* parents; /* per token, the group or lookaround it is in, or NOPARENT at the top level; per END, its group */
+	size_t nstates; /* number of states per position, or SIZE_MAX if there are too many to number */
+	size_t memolen; /* number of bytes of the memo in the work space, or 0 if it isn't there */
+	bool noting; /* whether the states tried in frames are noted on the trail, to go in the memo once they fail */
+	bool capped; /* whether the step limit of the budget has been lowered, as the memo can't be relied on */
+	size_t maxsteps; /* the step limit before that */
+	re_span* spans; /* per capturing group token, its last repetition, or NULL if it isn't capturing */
+	Trail* trail; /* the records of the choices that led to the current state, oldest first */
+	size_t ntrail; /* number of records on the trail */
+	size_t maxtrail; /* number of records there is room for */
+	size_t frame; /* index of the record of the innermost lookaround or atomic token being matched, or NOMATCH */
+	void* work; /* the work space that all of it is in */
+	size_t worklen; /* number of bytes of work */
+#ifdef RE_USE_MALLOC
+	void* heap; /* the work space, once it is allocated instead of given, or NULL */
+#endif
+} Backtracker;
+
+/* the engines that search can run, of which searchplan picks one per regex */
+typedef enum Engine
+{
+	ENGINE_LITERAL, /* literalsearch */
+	ENGINE_BACKWARD, /* nfamatchback */
+	ENGINE_NFA, /* dfasearch, then nfamatch */
+	ENGINE_BACKTRACKER /* backtracksearch */
+} Engine;
+
+/* the buffers that the NFAs work in, which re_match_batch sets up once for all of its texts */
+typedef struct Scratch
+{
+	NfaList* lists; /* the two lists of the NFAs */
+	size_t* marks; /* MAXNFA of them, for the NFAs */
+} Scratch;
+
+/* a string of chars that follow each other in every match */
+typedef struct RequiredString
+{
+	char chars[MAXLITERAL];
+	size_t n; /* number of chars */
+	bool fold; /* whether some of its letters ignore case */
+	bool exact; /* whether some of its letters don't */
+	size_t offset; /* most chars a match can eat before it, or SIZE_MAX if there is no limit */
+} RequiredString;
+
+/* the state of compilerequired while it goes through the tokens */
+typedef struct RequiredState
+{
+	RequiredString run; /* the string that the tokens seen last make up */
+	RequiredString best; /* the longest string so far */
+	size_t before; /* most chars a match can eat before the current token */
+} RequiredState;
+
+/* the start of the data written by re_serialize, which is followed by the Regex with its pointers cleared, its tokens, its class chars and its automata */
+typedef struct SerialHeader
+{
+	char magic[4]; /* "tre" and a NUL */
+	uint32_t version; /* SERIALVERSION */
+	uint32_t regexsize; /* sizeof(Regex), which depends on the limits in re.h and the platform */
+	uint32_t tokensize; /* sizeof(re_Token) */
+	uint32_t size; /* number of bytes in all, including the padding up to SERIALALIGN */
+} SerialHeader;
+
+/* compileregex: compiles pattern into compiled, storing its tokens and class chars in the given buffers and as much of its automata as fits in arena, which is aligned for NfaInst */
+static void compileregex(Regex* compiled, const char* pattern, re_Token* tokens, size_t maxtokens, ClassChar* cclbuf, size_t cclbuflen, void* arena, size_t arenalen);
+/* compilesize: works out the number of tokens, class chars and bytes of automata of pattern, returns the number of bytes that re_compilebuf needs for them all, or 0 if pattern is invalid */
+static size_t compilesize(const char* pattern, size_t* ntokens, size_t* ccli, size_t* automata);
+/* automataoffset: returns where the automata go in a buffer that starts with ntokens tokens (not counting END) and ccli class chars */
+static size_t automataoffset(size_t ntokens, size_t ccli);
+/* automatasize: returns the number of bytes that the automata of compiled take up together */
+static size_t automatasize(const Regex* compiled);
+/* layautomata: points the automata of compiled at their places in arena, without copying them there */
+static void layautomata(Regex* compiled, void* arena);
+/* storeautomata: copies the automata of compiled to arena and points them there */
+static void storeautomata(Regex* compiled, void* arena);
+/* fitautomata: stores the automata of compiled in arena, leaving out the DFA, then the backward program and then the NFA program until they fit in arenalen bytes */
+static void fitautomata(Regex* compiled, void* arena, size_t arenalen);
+/* validcounts: returns whether the flags of compiled, loaded by re_deserialize, are true or false, its counts are within the limits in re.h and its tokens, class chars and automata fit in len bytes */
+static bool validcounts(const Regex* compiled, size_t len);
+/* validbody: returns whether the tokens, class chars and automata of compiled, loaded by re_deserialize, only refer to what it has, so that matching stays inside them */
+static bool validbody(const Regex* compiled);
+/* validgroup: returns whether the tokens from pi up to end are whole groups and tokens other than END */
+static bool validgroup(const Regex* compiled, size_t pi, size_t end);
+/* validprogram: returns whether the n instructions of program only go to its own instructions and to the charsets and tokens of compiled */
+static bool validprogram(const Regex* compiled, const NfaInst* program, size_t n);
+/* compiletokens: compiles (or just counts) the tokens of pattern, returns the number of tokens not including the terminating END */
+static size_t compiletokens(const char* pattern, CompileState* state);
 /* compileone: compiles one regex token, returns number of chars eaten */
-static size_t compileone(re_Token* compiled, const char* pattern, ClassChar cclbuf[CCLBUFLEN], size_t* ccli);
+static size_t compileone(re_Token* compiled, const char* pattern, CompileState* state);
 /* compileoneclc: compiles one class character, returns number of chars eaten */
 static size_t compileoneclc(ClassChar* compiled, const char* pattern);
 /* compilerange: compiles a range, returns number of chars eaten */
@@ -50,34 +382,175 @@ static size_t compilequantifier(re_Token* compiled, const char* pattern);
 static size_t compilegreedy(re_Token* compiled, const char* pattern);
 /* compileatomic: sets whether the quantifier is atomic, returns number of chars eaten */
 static size_t compileatomic(re_Token* compiled, const char* pattern);
+/* compilefirstchars: adds every char that the tokens from pi up to the next END can start with to firstchars, returns whether they can match without eating a character */
+static bool compilefirstchars(const Regex* compiled, size_t pi, unsigned char firstchars[CHARSETLEN]);
+/* compilemaxlength: returns the most chars that the tokens from pi to the end of their group can eat, or SIZE_MAX if there is no limit */
+static size_t compilemaxlength(const Regex* compiled, size_t pi);
+/* compileminlength: returns the fewest chars that the tokens from pi to the end of their group can eat */
+static size_t compileminlength(const Regex* compiled, size_t pi);
+/* tokenminlength: returns the fewest chars that one repetition of the token at pi can eat */
+static size_t tokenminlength(const Regex* compiled, size_t pi);
+/* tokenlength: returns the most chars that the token at pi can eat once, or SIZE_MAX if there is no limit */
+static size_t tokenlength(const Regex* compiled, size_t pi);
+/* addlength: returns total plus times lengths, or SIZE_MAX if either is or times is QUANTIFIERMAX */
+static size_t addlength(size_t total, size_t length, size_t times);
+/* compilerequired: finds the longest string that every match has to have in it */
+static void compilerequired(Regex* compiled);
+/* requiredscan: goes through the tokens from pi to the end of their group, looking for strings that have to be matched */
+static void requiredscan(const Regex* compiled, size_t pi, RequiredState* state);
+/* endrequired: ends the string being put together, keeping it if it is the longest so far */
+static void endrequired(RequiredState* state);
+/* capturenumber: returns the number of the capturing group at index pi, counting from 1 */
+static size_t capturenumber(const Regex* compiled, size_t pi);
+/* iszerowidth: returns whether a token never eats any characters */
+static bool iszerowidth(const re_Token* token);
+/* isgroup: returns whether a token starts a group or lookaround, which is followed by its tokens and END */
+static bool isgroup(const re_Token* token);
+/* isloop: returns whether the backtracker repeats a token one repetition at a time: it is a group or \R, which can eat one or two chars */
+static bool isloop(const re_Token* token);
+/* compilefolds: lowercases the chars and char ranges of the tokens that ignore case, so that only the text has to be folded while matching */
+static void compilefolds(Regex* compiled);
+/* compilecharsets: gives every token that always eats exactly one char a charset */
+static void compilecharsets(Regex* compiled);
+/* compilecharset: gives the token at pi a charset, if it always eats exactly one char and there is room for its set */
+static void compilecharset(Regex* compiled, size_t pi);
+/* compileranges: works out whether a charset can be described by a few ranges, so that it can be scanned with SIMD */
+static void compileranges(CharSet* set);
+/* compilenfa: compiles the tokens into an NFA program and DFA if the regex doesn't need backtracking */
+static void compilenfa(Regex* compiled);
+/* compileliteral: finds out whether the regex is a plain string that can be searched for without the matching engines */
+static void compileliteral(Regex* compiled);
+/* compilebackward: compiles the program that matches the regex backwards from the end of the text, if every match has to end there */
+static void compilebackward(Regex* compiled);
+/* emitnfa: emits the NFA instructions for the tokens from pi up to the next END (last to first if reverse is set), returns false if that isn't possible */
+static bool emitnfa(Regex* compiled, size_t pi, bool reverse);
+/* emitnfaquantified: emits the NFA instructions for a token including its quantifier, returns false if that isn't possible */
+static bool emitnfaquantified(Regex* compiled, size_t pi, bool reverse);
+/* patchnfasplit: points a SPLIT at the body right after it and at the end of the program so far */
+static void patchnfasplit(Regex* compiled, size_t split, bool greedy);
+/* emitnfaone: emits the NFA instructions for a token ignoring its quantifier, returns false if that isn't possible */
+static bool emitnfaone(Regex* compiled, size_t pi, bool reverse);
+/* emitnfainst: appends an instruction to the NFA program, returns false if it is full */
+static bool emitnfainst(Regex* compiled, NfaOp op, unsigned char arg, size_t x, size_t y);
+/* compiledfa: builds the DFA from the NFA program by subset construction, if it is small enough */
+static void compiledfa(Regex* compiled);
+/* dfastep: works out the DFA state after a char (or the end of the text, if end is set), returns whether the regex has matched before it */
+static bool dfastep(const Regex* compiled, const NfaSet* state, bool end, char c, NfaSet* next);
 
-/* matchpattern: matches one pattern on a string, returns number of chars eaten */
-static size_t matchpattern(const re_Token* pattern, size_t* positions, Quantifier* counts, size_t pi, const char* text, size_t i);
-/* backtrack: backtrack into the pattern, returns new starting index */
-static size_t backtrack(const re_Token* pattern, Quantifier* counts, size_t pi);
-/* matchcount: matches one regex token including quantifiers and sets count for number of quantifiers, returns number of characters eaten */
-static size_t matchcount(const re_Token* pattern, size_t* postiions, Quantifier* counts, size_t pi, const char* text, size_t i);
-/* matchone: matches one regex token ignoring quantifiers, returns number of characters eaten */
-static size_t matchone(const re_Token* pattern, size_t* positions, Quantifier* counts, size_t pi, const char* text, size_t i);
+/* backtracksearch: same as searchengine with ENGINE_BACKTRACKER, once the checks that every engine shares are done */
+static size_t backtracksearch(const Regex* pattern, const char* text, size_t len, size_t from, size_t last, size_t* length, re_span* spans, size_t ngroups, Budget* budget);
+/* btinit: lays out the backtracker in the work space of its budget, or in the stacklen bytes at stack if there is none, with spans if they are asked for; returns false if it doesn't fit */
+static bool btinit(Backtracker* bt, void* stack, size_t stacklen, bool spans);
+/* btlayout: points the registers and the trail of the backtracker into the worklen bytes at work */
+static void btlayout(Backtracker* bt, void* work, size_t worklen);
+/* btgrow: makes room for more records on the trail, if need be by dropping the states still to be noted; returns false (and marks the budget full) if there is none */
+static bool btgrow(Backtracker* bt);
+/* btcap: lowers the step limit of the budget to a few steps per state, once the memo doesn't keep the backtracker from trying them over and over */
+static void btcap(Backtracker* bt);
+/* btpush: pushes a record on the trail, returns false if there is no room for it */
+static inline bool btpush(Backtracker* bt, uint32_t kind, size_t pi, size_t a, size_t b);
+/* btframe: starts matching the tokens of the lookaround or atomic token at pi from index i, returns false if there is no room */
+static bool btframe(Backtracker* bt, size_t pi, size_t i);
+/* btcount: starts repeating the group or \R at pi from index i, returns false if there is no room */
+static bool btcount(Backtracker* bt, size_t pi, size_t i);
+/* btundo: undoes what a record popped off the trail notes */
+static void btundo(Backtracker* bt, const Trail* record);
+/* btcut: ends the innermost frame once its token has matched, dropping its choices but keeping what it captured */
+static void btcut(Backtracker* bt);
+/* btdiscard: ends the innermost frame as if its token had never been tried, once a negative lookaround has matched */
+static void btdiscard(Backtracker* bt);
+/* btclasses: returns the number of classes that the counts of the group at pi fall into for the tokens in it, or for a lookbehind, the number of places they can be at before its end */
+static size_t btclasses(const Backtracker* bt, size_t pi);
+/* btstate: finds the state of token pi at index i, which is only the same for two tries of it if the rest of its frame can match in the same ways from both: */
+/* the counts of the groups around it (as far as they tell apart), and where its lookbehind ends; sets top if it isn't in any frame */
+/* returns false if it can't be part of a match, as it is past where its lookbehind ends */
+static bool btstate(const Backtracker* bt, size_t pi, size_t i, size_t* state, bool* top);
+/* btlimit: returns the index that the tokens being matched can't eat past: where the innermost lookbehind around them ends, or the end of the text */
+static size_t btlimit(const Backtracker* bt);
+/* btmatch: matches the regex from index start, returns the number of chars eaten or NOMATCH */
+static size_t btmatch(Backtracker* bt, size_t start);
+/* btback: pops the trail down to the last choice that is left and takes it, by setting the token, index and step to go on from; returns false if there is none */
+static bool btback(Backtracker* bt, size_t* pi, size_t* i, Step* step);
+/* runbody: returns the token that eats the chars of a run of token pi: pi itself, or the token in a non-capturing group of nothing but one token */
+/* that eats one char, such as (?s:.), which is repeated like that token; returns NOMATCH for the other groups and \R, which are repeated one at a time */
+static size_t runbody(const Regex* pattern, size_t pi);
+/* runnext: returns whether the token after the run of token pi can start at index i, as far as its charset and the memo tell */
+static bool runnext(Backtracker* bt, size_t pi, size_t i);
+/* runone: returns whether token pi, which eats one char each time, eats the one at index i < len */
+static inline bool runone(const Regex* pattern, size_t pi, const char* text, size_t len, size_t i);
+/* runlength: returns the number of times (at most n) that token pi, which eats one char each time, matches one after another from index i */
+static size_t runlength(const Regex* pattern, Budget* budget, size_t pi, const char* text, size_t len, size_t i, size_t n);
+/* memfailed: returns whether the rest of the frame is known to fail from state at position pos */
+static bool memfailed(Memo* memo, size_t state, size_t pos);
+/* memfail: notes that the rest of the frame fails from state at position pos, which memfailed has looked at */
+static void memfail(Memo* memo, size_t state, size_t pos);
+/* inset: returns whether c is in set */
+static inline bool inset(const CharSet* set, char c);
+/* spanset: returns the number of chars at the start of text (at most n) that are in set if in is true, or not in set if in is false */
+static size_t spanset(const CharSet* set, bool in, const char* text, size_t n);
+/* skipfirstchars: returns the index of the first char of text from index i that a match can start with, or len if there is none */
+static size_t skipfirstchars(const Regex* pattern, const char* text, size_t len, size_t i);
+/* setsearch: matches every regex of set (at most SETBLOCK of them) against text, sets the bits of the ones that match in matched (which must start cleared) and stores where they match in spans if it isn't NULL, returns number of regexes that matched; sets errno to ENOBUFS if the backtracker ran out of room for one */
+static size_t setsearch(const RegexSet* set, const char* text, size_t len, unsigned char* matched, re_span* spans);
+/* setsintersect: returns whether two charsets have a char in common */
+static bool setsintersect(const CharSet* a, const CharSet* b);
+/* matchassert: returns whether a zero-width NFA assertion holds at a position in the text */
+static bool matchassert(unsigned char assertion, bool atstart, bool atend, bool prevword, bool nextword);
+/* dfasearch: returns whether the regex matches anywhere in text, using the DFA */
+static bool dfasearch(const Regex* pattern, const char* text, size_t len);
+/* nfaaddthread: adds a thread at pc of program to list, following zero-width instructions; slots are the capture slots of the thread */
+static void nfaaddthread(const NfaInst* program, NfaList* list, size_t* marks, size_t pc, size_t start, const size_t* slots, size_t nslots, const NfaContext* context);
+/* nfacontext: works out what the zero-width instructions can see at index i of text */
+static void nfacontext(NfaContext* context, const char* text, size_t len, size_t i);
+/* streamstep: moves the stream past the char c at the position of context, or past the end of the text if c is NULL */
+static void streamstep(RegexStream* stream, const NfaContext* context, const char* c);
+/* nfamatch: finds the first match from index from by simulating the NFA, returns its index and stores its length in length and the spans of its first ngroups groups (at most MAXNFASLOTS / 2) in spans, or returns NOMATCH */
+static size_t nfamatch(const Regex* pattern, Scratch* scratch, const char* text, size_t len, size_t from, size_t last, size_t* length, re_span* spans, size_t ngroups, Budget* budget);
+/* nfamatchback: same as nfamatch without slots, but runs the backward program from the end of the text down to from */
+static size_t nfamatchback(const Regex* pattern, Scratch* scratch, const char* text, size_t len, size_t from, size_t last, size_t* length, Budget* budget);
+/* searchplan: returns the engine that search runs for the regex, when the spans of ngroups groups are to be filled */
+static Engine searchplan(const Regex* pattern, size_t ngroups);
+/* search: finds the first match from index from with whichever engine suits the regex, returns its index and stores its length in length and the spans of its first ngroups groups in spans (with start NOMATCH for those that didn't take part), or returns NOMATCH */
+static size_t search(const Regex* pattern, const char* text, size_t len, size_t from, size_t last, size_t* length, re_span* spans, size_t ngroups, Budget* budget);
+/* searchwith: same as search, but with the engine given by searchplan and the buffers in scratch */
+static size_t searchwith(const Regex* pattern, Engine engine, Scratch* scratch, const char* text, size_t len, size_t from, size_t last, size_t* length, re_span* spans, size_t ngroups, Budget* budget);
+/* searchengine: same as searchwith, but without counting the search itself in the stats */
+static size_t searchengine(const Regex* pattern, Engine engine, Scratch* scratch, const char* text, size_t len, size_t from, size_t last, size_t* length, re_span* spans, size_t ngroups, Budget* budget);
+/* searchcaptures: same as search, but stores the span of the match and of its capturing groups in caps like re_match_captures */
+static size_t searchcaptures(const Regex* pattern, const char* text, size_t len, size_t from, re_span* caps, size_t ncaps, Budget* budget);
+/* literalsearch: same as search for a regex that is a literal */
+static size_t literalsearch(const Regex* pattern, const char* text, size_t len, size_t from, size_t last, size_t* length, Budget* budget);
+/* findrequired: returns the index of the first place from from on where the required string of pattern is in text, or NOMATCH */
+static size_t findrequired(const Regex* pattern, const char* text, size_t len, size_t from);
+/* spend: takes steps out of budget, returns whether the search has to give up */
+static inline bool spend(Budget* budget, size_t steps);
+#ifdef RE_USE_STATS
+/* cycles: returns the CPU's time stamp counter, or clock() where there is none */
+static inline uint64_t cycles(void);
+#endif
+/* cachelock: waits until no other thread uses cache, then takes it */
+static void cachelock(RegexCache* cache);
+/* cacheunlock: lets other threads use cache again */
+static void cacheunlock(RegexCache* cache);
+/* cachehash: returns the hash of a pattern, by which it is looked up in a RegexCache */
+static uint64_t cachehash(const char* pattern);
+/* cacheevict: returns the index of an entry that can be reused, throwing out the regex in it if there is one, or returns NOMATCH if every entry is in use */
+static size_t cacheevict(RegexCache* cache);
+/* chunkstep: searches for a match starting from pos up to the end of chunk, returns the position after it where the next search starts, or NOMATCH; sets full if the backtracker ran out of room */
+static size_t chunkstep(RegexChunk* chunk, size_t pos);
+/* literalat: returns whether the literal of the regex is at index i of text, which has room for it */
+static bool literalat(const Regex* pattern, const char* text, size_t i);
+/* repeatmax: returns the most times the token at pi can be repeated, or SIZE_MAX if there is no limit */
+static inline size_t repeatmax(const Regex* pattern, size_t pi);
+/* matchone: matches one regex token other than a group or lookaround ignoring quantifiers, returns number of characters eaten; budget is where it is counted, or NULL */
+static inline size_t matchone(const Regex* pattern, Budget* budget, size_t pi, const char* text, size_t len, size_t i);
 /* matchoneclc: matches one class character, returns number of chars eaten */
-static size_t matchoneclc(ClassChar pattern, const char* text, size_t i, Modifiers modifiers);
-/* more matching functions */
-static size_t matchwhitespace     (const char* text, size_t i, Modifiers modifiers);
-static size_t matchnotwhitespace  (const char* text, size_t i, Modifiers modifiers);
-static size_t matchdigit          (const char* text, size_t i, Modifiers modifiers);
-static size_t matchnotdigit       (const char* text, size_t i, Modifiers modifiers);
-static size_t matchwordchar       (const char* text, size_t i, Modifiers modifiers);
-static size_t matchnotwordchar    (const char* text, size_t i, Modifiers modifiers);
-static size_t matchnewline        (const char* text, size_t i, Modifiers modifiers);
-static size_t matchwordboundary   (const char* text, size_t i, Modifiers modifiers);
-static size_t matchnotwordboundary(const char* text, size_t i, Modifiers modifiers);
-
-static size_t matchstart          (const char* text, size_t i, Modifiers modifiers);
-static size_t matchend            (const char* text, size_t i, Modifiers modifiers);
-static size_t matchany            (const char* text, size_t i, Modifiers modifiers);
+static size_t matchoneclc(ClassChar pattern, const char* text, size_t len, size_t i, Modifiers modifiers);
+/* matchmeta: matches a metabsl or metachar, given by the char after the backslash or the metachar itself, returns number of chars eaten */
+static inline size_t matchmeta(char meta, const char* text, size_t len, size_t i, Modifiers modifiers);
 
 /* printone: prints one regex token */
-static void printone(re_Token pattern);
+static void printone(re_Token pattern, const ClassChar* cclbuf);
 /* printoneclc: prints one class character */
 static void printoneclc(ClassChar pattern);
 
@@ -86,35 +559,34 @@ static void printoneclc(ClassChar pattern);
  */
 
 /* the array of all metabsls (sequences that begin with a backslash) */
+/* they are matched by matchmeta */
 const struct
 {
 	char pattern;
-	size_t (*validator)(const char*, size_t, Modifiers);
 }
 metabsls[] =
 {
-	{'s', matchwhitespace},
-	{'S', matchnotwhitespace},
-	{'d', matchdigit},
-	{'D', matchnotdigit},
-	{'w', matchwordchar},
-	{'W', matchnotwordchar},
-	{'R', matchnewline},
-	{'b', matchwordboundary},
-	{'B', matchnotwordboundary}
+	{'s'}, /* whitespace */
+	{'S'}, /* not whitespace */
+	{'d'}, /* digit */
+	{'D'}, /* not digit */
+	{'w'}, /* word char */
+	{'W'}, /* not word char */
+	{'R'}, /* newline, including \r\n */
+	{'b'}, /* word boundary */
+	{'B'}  /* not word boundary */
 };
 
 /* the array of all metachars */
 const struct
 {
 	char pattern;
-	size_t (*validator)(const char*, size_t, Modifiers);
 }
 metachars[] =
 {
-	{'^', matchstart},
-	{'$', matchend},
-	{'.', matchany}
+	{'^'}, /* start of the text */
+	{'$'}, /* end of the text */
+	{'.'}  /* any char but \n, or any char at all with (?s) */
 };
 
 /* the array of all quantifiers */
@@ -147,66 +619,642 @@ modifierchars[] =
 	{'<', MOD_B}  /* backwards */
 };
 
-/*
- * GLOBAL VARIABLES
- */
-
-/* stack of pointers to GROUP/CGROUP/LOOKAROUND/INVLOOKAROUND tokens, used by compilation */
-re_Token* groupstack[MAXGROUPS] = {0};
-size_t groupstacki = 0;
-
 /*
  * COMPILATION FUNCTIONS
  */
 
 void re_compile(Regex* compiled, const char* pattern)
 {
-	groupstacki = 0;
-	compiled->ccli = 0;
+	compileregex(compiled, pattern, compiled->inlinetokens, MAXTOKENS, compiled->inlinecclbuf, CCLBUFLEN, compiled->inlineautomata, sizeof(compiled->inlineautomata));
+}
+
+size_t re_compilesize(const char* pattern)
+{
+	size_t ntokens, ccli, automata;
+	return compilesize(pattern, &ntokens, &ccli, &automata);
+}
+
+void re_compilebuf(Regex* compiled, const char* pattern, void* buf, size_t size)
+{
+	compiled->tokens = compiled->inlinetokens;
+	CompileState state = {.tokens = NULL, .cclbuf = NULL};
+	const size_t ntokens = compiletokens(pattern, &state);
+	if (errno)
+		return;
+	if (size < (ntokens + 1) * sizeof(re_Token) + state.ccli * sizeof(ClassChar)) {
+		errno = ENOBUFS;
+		return;
+	}
+	/* the tokens go at the start of buf, the class chars right after them and the automata in what is left */
+	re_Token* tokens = buf;
+	const size_t offset = automataoffset(ntokens, state.ccli);
+	compileregex(compiled, pattern, tokens, ntokens + 1, (ClassChar*)&tokens[ntokens + 1], state.ccli, (unsigned char*)buf + offset, size > offset ? size - offset : 0);
+}
+
+#ifdef RE_USE_MALLOC
+void re_compilealloc(Regex* compiled, const char* pattern)
+{
+	compiled->tokens = compiled->inlinetokens;
+	size_t ntokens, ccli, automata;
+	const size_t size = compilesize(pattern, &ntokens, &ccli, &automata);
+	if (errno)
+		return;
+	if (ntokens < MAXTOKENS && ccli <= CCLBUFLEN && automata <= sizeof(compiled->inlineautomata)) {
+		/* small enough for the Regex itself */
+		re_compile(compiled, pattern);
+		return;
+	}
+	void* buf = malloc(size);
+	if (!buf) {
+		errno = ENOMEM;
+		return;
+	}
+	re_compilebuf(compiled, pattern, buf, size);
+}
+
+void re_free(Regex* compiled)
+{
+	if (compiled->tokens != compiled->inlinetokens)
+		free(compiled->tokens);
+	compiled->tokens = compiled->inlinetokens;
+}
+#endif
+
+void re_cache_init(RegexCache* cache, RegexCacheEntry* entries, size_t nentries)
+{
+	cache->entries = entries;
+	cache->nentries = nentries;
+	cache->hand = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->evictions = 0;
+	cache->lock = 0;
+	for (size_t e = 0; e < nentries; ++e) {
+		entries[e].full = false;
+		entries[e].refs = 0;
+		entries[e].head = 0;
+		entries[e].next = 0;
+	}
+}
+
+const Regex* re_cache_get(RegexCache* cache, const char* pattern)
+{
+	const size_t n = strlen(pattern);
+	if (n >= MAXCACHEPATTERN || !cache->nentries) {
+		errno = ENOBUFS;
+		return NULL;
+	}
+	const uint64_t hash = cachehash(pattern);
+	const size_t bucket = hash % cache->nentries;
+	cachelock(cache);
+	for (size_t e = cache->entries[bucket].head; e; e = cache->entries[e-1].next) {
+		RegexCacheEntry* entry = &cache->entries[e-1];
+		if (entry->hash == hash && !memcmp(entry->pattern, pattern, n+1)) {
+			++entry->refs;
+			entry->used = true;
+			++cache->hits;
+			cacheunlock(cache);
+			errno = 0;
+			return &entry->regex;
+		}
+	}
+	const size_t e = cacheevict(cache);
+	if (e == NOMATCH) {
+		cacheunlock(cache);
+		errno = ENOBUFS;
+		return NULL;
+	}
+	/* the pattern is compiled while the cache is taken, so that another thread asking for it too doesn't compile it again */
+	RegexCacheEntry* entry = &cache->entries[e];
+	++cache->misses;
+	re_compile(&entry->regex, pattern);
+	if (errno) {
+		const int error = errno;
+		cacheunlock(cache);
+		errno = error;
+		return NULL;
+	}
+	memcpy(entry->pattern, pattern, n+1);
+	entry->hash = hash;
+	entry->full = true;
+	entry->used = true;
+	entry->refs = 1;
+	entry->next = cache->entries[bucket].head;
+	cache->entries[bucket].head = e+1;
+	cacheunlock(cache);
+	errno = 0;
+	return &entry->regex;
+}
+
+void re_cache_release(RegexCache* cache, const Regex* compiled)
+{
+	/* the Regex is the first member of its entry, so a regex from the cache is at the start of one of its entries */
+	const uintptr_t at = (uintptr_t)compiled, first = (uintptr_t)cache->entries;
+	if (at < first || (at - first) % sizeof(RegexCacheEntry) || (at - first) / sizeof(RegexCacheEntry) >= cache->nentries) {
+		errno = EINVAL;
+		return;
+	}
+	RegexCacheEntry* entry = &cache->entries[(at - first) / sizeof(RegexCacheEntry)];
+	cachelock(cache);
+	if (!entry->full || !entry->refs) {
+		/* released more often than it was got, which would leave it held for good */
+		cacheunlock(cache);
+		errno = EINVAL;
+		return;
+	}
+	--entry->refs;
+	cacheunlock(cache);
+	errno = 0;
+}
+
+void re_set_compile(RegexSet* set, Regex* regexes, const char* const* patterns, size_t npatterns)
+{
+	set->regexes = regexes;
+	for (set->nregexes = 0; set->nregexes < npatterns; ++set->nregexes) {
+		re_compile(&regexes[set->nregexes], patterns[set->nregexes]);
+		if (errno)
+			return;
+	}
+}
+
+size_t re_serialize(const Regex* compiled, void* buf, size_t size)
+{
+	const size_t tokensize = (compiled->ntokens + 1) * sizeof(re_Token);
+	const size_t cclsize = compiled->ccli * sizeof(ClassChar);
+	/* the tokens, class chars and automata are laid out as re_compilebuf does in its buffer */
+	const size_t offset = automataoffset(compiled->ntokens, compiled->ccli);
+	const size_t automata = automatasize(compiled);
+	const size_t needed = (sizeof(SerialHeader) + sizeof(Regex) + offset + automata + SERIALALIGN - 1) / SERIALALIGN * SERIALALIGN;
+	if (size < needed || needed > UINT32_MAX) {
+		errno = ENOBUFS;
+		return needed;
+	}
+	errno = 0;
+	unsigned char* out = buf;
+	unsigned char* data = out + sizeof(SerialHeader) + sizeof(Regex);
+	SerialHeader header = {{'t', 'r', 'e', '\0'}, SERIALVERSION, sizeof(Regex), sizeof(re_Token), (uint32_t)needed};
+	memcpy(out, &header, sizeof(header));
+	memcpy(data, compiled->tokens, tokensize);
+	memcpy(data + tokensize, compiled->cclbuf, cclsize);
+	memset(data + tokensize + cclsize, 0, offset - (tokensize + cclsize));
+	Regex copy = *compiled;
+	storeautomata(&copy, data + offset);
+	memset(data + offset + automata, 0, needed - (sizeof(header) + sizeof(copy) + offset + automata));
+	/* the pointers are the only part of the Regex that depends on where it is */
+	copy.tokens = NULL;
+	copy.cclbuf = NULL;
+	copy.nfa = copy.rnfa = NULL;
+	copy.byteclass = copy.dfa = NULL;
+#ifdef RE_USE_STATS
+	copy.stats = NULL;
+#endif
+	memcpy(out + sizeof(header), &copy, sizeof(copy));
+	return needed;
+}
+
+size_t re_deserialize(Regex* compiled, const void* data, size_t size)
+{
+	const unsigned char* in = data;
+	SerialHeader header;
+	if (size < sizeof(header) + sizeof(Regex)) {
+		errno = EINVAL;
+		return 0;
+	}
+	memcpy(&header, in, sizeof(header));
+	if (memcmp(header.magic, "tre", 4) || header.version != SERIALVERSION || header.regexsize != sizeof(Regex) || header.tokensize != sizeof(re_Token) || header.size > size || header.size < sizeof(header) + sizeof(Regex)) {
+		/* not written by re_serialize, or by a build that lays out the Regex differently */
+		errno = EINVAL;
+		return 0;
+	}
+	memcpy(compiled, in + sizeof(header), sizeof(Regex));
+	/* the data may have been damaged, so nothing in it is used before it is checked */
+	if (!validcounts(compiled, header.size - (sizeof(header) + sizeof(Regex)))) {
+		errno = EINVAL;
+		return 0;
+	}
+	const size_t tokensize = (compiled->ntokens + 1) * sizeof(re_Token);
+	const size_t cclsize = compiled->ccli * sizeof(ClassChar);
+	const size_t automata = automatasize(compiled);
+	unsigned char* body = (unsigned char*)(in + sizeof(header) + sizeof(Regex));
+	compiled->tokens = (re_Token*)body;
+	compiled->cclbuf = (ClassChar*)(body + tokensize);
+	layautomata(compiled, body + automataoffset(compiled->ntokens, compiled->ccli));
+	if (!validbody(compiled)) {
+		errno = EINVAL;
+		return 0;
+	}
+	errno = 0;
+	/* the tokens and automata of the regex are used where they are, unless they fit in the Regex itself */
+	if (compiled->ntokens < MAXTOKENS && compiled->ccli <= CCLBUFLEN && automata <= sizeof(compiled->inlineautomata)) {
+		memcpy(compiled->inlinetokens, compiled->tokens, tokensize);
+		memcpy(compiled->inlinecclbuf, compiled->cclbuf, cclsize);
+		compiled->tokens = compiled->inlinetokens;
+		compiled->cclbuf = compiled->inlinecclbuf;
+		storeautomata(compiled, compiled->inlineautomata);
+	}
+#ifdef RE_USE_STATS
+	compiled->stats = NULL;
+#endif
+	return header.size;
+}
+
+void re_info(const Regex* pattern, RegexInfo* info)
+{
+	info->minlength = pattern->minlength;
+	info->maxlength = pattern->maxlength;
+	info->ncaptures = pattern->ncaptures;
+	info->anchored = pattern->anchored;
+	/* plain strings aren't given to the NFA, but are searched for in linear time anyway */
+	info->linear = pattern->nnfa || pattern->nliteral;
+	info->nrequired = pattern->nliteral ? pattern->nliteral : pattern->nrequired;
+}
+
+#ifdef RE_USE_STATS
+void re_stats_attach(Regex* pattern, re_stats* stats)
+{
+	pattern->stats = stats;
+}
+#endif
+
+static void compileregex(Regex* compiled, const char* pattern, re_Token* tokens, size_t maxtokens, ClassChar* cclbuf, size_t cclbuflen, void* arena, size_t arenalen)
+{
+	CompileState state = {.tokens = tokens, .maxtokens = maxtokens, .cclbuf = cclbuf, .cclbuflen = cclbuflen};
+	compiled->tokens = tokens;
+	compiled->cclbuf = cclbuf;
+#ifdef RE_USE_STATS
+	compiled->stats = NULL;
+#endif
+	compiled->ntokens = compiletokens(pattern, &state);
+	compiled->ccli = state.ccli;
+	if (errno)
+		return;
+	compiled->ncaptures = capturenumber(compiled, compiled->ntokens);
+
+	compilefolds(compiled);
+	compilecharsets(compiled);
+	/* the automata are built as large as they can be, then moved to arena */
+	NfaInst nfa[MAXNFA];
+	NfaInst rnfa[MAXNFA];
+	unsigned char byteclass[CHARSETLEN * 8];
+	unsigned char dfa[MAXDFATRANS];
+	compiled->nfa = nfa;
+	compiled->rnfa = rnfa;
+	compiled->byteclass = byteclass;
+	compiled->dfa = dfa;
+	compilenfa(compiled);
+	fitautomata(compiled, arena, arenalen);
+	compileliteral(compiled);
+	compiled->maxlength = compilemaxlength(compiled, 0);
+	compiled->minlength = compileminlength(compiled, 0);
+	compilerequired(compiled);
+
+	/* find out which chars a match can start with, so that re_match can skip the positions where no match can start */
+	memset(compiled->firstchars.map, 0, sizeof(compiled->firstchars.map));
+	compiled->prefilter = !compilefirstchars(compiled, 0, compiled->firstchars.map);
+	compileranges(&compiled->firstchars);
+	compiled->nfirstchars = 0;
+	for (unsigned c = 0; c <= UCHAR_MAX; ++c) {
+		if (inset(&compiled->firstchars, (char)c)) {
+			compiled->firstchar = (char)c;
+			++compiled->nfirstchars;
+		}
+	}
+}
+
+static size_t compilesize(const char* pattern, size_t* ntokens, size_t* ccli, size_t* automata)
+{
+	CompileState state = {.tokens = NULL, .cclbuf = NULL};
+	*ntokens = compiletokens(pattern, &state);
+	*ccli = state.ccli;
+	*automata = 0;
+	if (errno)
+		return 0;
+	if (*ntokens > MAXNFATOKENS || *ccli > MAXNFACCL)
+		/* too large for compilenfa to build automata for */
+		return automataoffset(*ntokens, *ccli);
+	/* the size of the automata is only known once they are built */
+	re_Token tokens[MAXNFATOKENS + 1];
+	ClassChar cclbuf[MAXNFACCL];
+	NfaInst arena[(MAXAUTOMATALEN + sizeof(NfaInst) - 1) / sizeof(NfaInst)];
+	Regex compiled;
+	compileregex(&compiled, pattern, tokens, *ntokens + 1, cclbuf, *ccli, arena, sizeof(arena));
+	if (errno)
+		return 0;
+	*automata = automatasize(&compiled);
+	return automataoffset(*ntokens, *ccli) + *automata;
+}
+
+static size_t automataoffset(size_t ntokens, size_t ccli)
+{
+	/* the buffer is aligned like malloc's memory, so a multiple of sizeof(NfaInst) is aligned for it */
+	const size_t end = (ntokens + 1) * sizeof(re_Token) + ccli * sizeof(ClassChar);
+	return (end + sizeof(NfaInst) - 1) / sizeof(NfaInst) * sizeof(NfaInst);
+}
+
+static size_t automatasize(const Regex* compiled)
+{
+	const size_t dfasize = compiled->ndfastates ? CHARSETLEN * 8 + compiled->ndfastates * (compiled->nbyteclasses + 1) : 0;
+	return (compiled->nnfa + compiled->nrnfa) * sizeof(NfaInst) + dfasize;
+}
+
+static void layautomata(Regex* compiled, void* arena)
+{
+	/* the programs go first, so that they are aligned like arena */
+	compiled->nfa = arena;
+	compiled->rnfa = compiled->nfa + compiled->nnfa;
+	compiled->byteclass = (unsigned char*)(compiled->rnfa + compiled->nrnfa);
+	compiled->dfa = compiled->byteclass + CHARSETLEN * 8;
+}
+
+static void storeautomata(Regex* compiled, void* arena)
+{
+	const Regex from = *compiled;
+	layautomata(compiled, arena);
+	memcpy(compiled->nfa, from.nfa, from.nnfa * sizeof(from.nfa[0]));
+	memcpy(compiled->rnfa, from.rnfa, from.nrnfa * sizeof(from.rnfa[0]));
+	if (from.ndfastates) {
+		memcpy(compiled->byteclass, from.byteclass, CHARSETLEN * 8);
+		memcpy(compiled->dfa, from.dfa, from.ndfastates * (from.nbyteclasses + 1));
+	}
+}
+
+static void fitautomata(Regex* compiled, void* arena, size_t arenalen)
+{
+	/* the DFA and the backward program only speed up what the NFA program can do, and the backtracker can do what any of them can */
+	if (automatasize(compiled) > arenalen)
+		compiled->ndfastates = 0;
+	if (automatasize(compiled) > arenalen)
+		compiled->nrnfa = 0;
+	if (automatasize(compiled) > arenalen)
+		compiled->nnfa = 0;
+	storeautomata(compiled, arena);
+}
+
+static bool validcounts(const Regex* compiled, size_t len)
+{
+	/* each count is checked before it is multiplied, so that the sizes can't wrap around */
+	if (compiled->ntokens >= len / sizeof(re_Token))
+		return false;
+	const size_t tokensize = (compiled->ntokens + 1) * sizeof(re_Token);
+	if (compiled->ccli > (len - tokensize) / sizeof(ClassChar))
+		return false;
+	if (compiled->ncharsets > MAXCHARSETS || compiled->nliteral > MAXLITERAL || compiled->nrequired > MAXLITERAL)
+		return false;
+	/* the searches only look for the literal or required string where a match fits */
+	if (compiled->nliteral > compiled->minlength || compiled->nrequired > compiled->minlength)
+		return false;
+	if (compiled->nnfa > MAXNFA || compiled->nrnfa > MAXNFA)
+		return false;
+	if (compiled->ndfastates && (compiled->ndfastates > MAXDFASTATES || !compiled->nbyteclasses || compiled->nbyteclasses > CHARSETLEN * 8 || compiled->ndfastates * (compiled->nbyteclasses + 1) > MAXDFATRANS))
+		return false;
+	/* a bool that is neither can't even be read */
+	const bool* flags[] = {&compiled->prefilter, &compiled->anchored, &compiled->literalfold, &compiled->literalend, &compiled->requiredfold};
+	for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); ++i) {
+		if (*(const unsigned char*)flags[i] > 1)
+			return false;
+	}
+	/* the automata are now at most MAXAUTOMATALEN bytes */
+	return automataoffset(compiled->ntokens, compiled->ccli) + automatasize(compiled) <= len;
+}
+
+static bool validbody(const Regex* compiled)
+{
+	const re_Token* end = &compiled->tokens[compiled->ntokens];
+	if (end->type != TOKEN_END || end->grouplen != UINT32_MAX || !validgroup(compiled, 0, compiled->ntokens))
+		return false;
+	/* the ENDs of the groups have been checked by validgroup, so only what is inside them is left */
+	size_t ncaptures = 0;
+	for (size_t pi = 0; pi < compiled->ntokens; ++pi) {
+		const re_Token* token = &compiled->tokens[pi];
+		if (token->charset != NOCHARSET && token->charset >= compiled->ncharsets)
+			return false;
+		size_t ci;
+		switch (token->type) {
+			case TOKEN_END:
+			case TOKEN_CHAR:
+				break;
+			case TOKEN_CGROUP:
+				++ncaptures;
+				/* fall through */
+			case TOKEN_GROUP:
+			case TOKEN_LOOKAROUND:
+			case TOKEN_INVLOOKAROUND:
+				if (!validgroup(compiled, pi+1, pi + token->grouplen))
+					return false;
+				break;
+			case TOKEN_METABSL:
+				if (token->meta >= sizeof(metabsls) / sizeof(metabsls[0]))
+					return false;
+				break;
+			case TOKEN_METACHAR:
+				if (token->meta >= sizeof(metachars) / sizeof(metachars[0]))
+					return false;
+				break;
+			case TOKEN_CHARCLASS:
+			case TOKEN_INVCHARCLASS:
+				/* the class has to end before the class chars do */
+				for (ci = token->ccl; ci < compiled->ccli && compiled->cclbuf[ci].type != CCL_END; ++ci);
+				if (ci >= compiled->ccli)
+					return false;
+				break;
+			default:
+				return false;
+		}
+	}
+	if (ncaptures != compiled->ncaptures)
+		return false;
+	for (size_t ci = 0; ci < compiled->ccli; ++ci) {
+		const ClassChar* cc = &compiled->cclbuf[ci];
+		if (cc->type > CCL_CHARRANGE || (cc->type == CCL_METABSL && cc->meta >= sizeof(metabsls) / sizeof(metabsls[0])))
+			return false;
+	}
+
+	for (size_t seti = 0; seti < compiled->ncharsets; ++seti) {
+		if (compiled->charsets[seti].nranges > MAXCHARSETRANGES)
+			return false;
+	}
+	if (compiled->firstchars.nranges > MAXCHARSETRANGES)
+		return false;
+	/* a skip of 0 would never get past the char */
+	for (size_t c = 0; compiled->nrequired && c < sizeof(compiled->requiredskip); ++c) {
+		if (!compiled->requiredskip[c] || compiled->requiredskip[c] > compiled->nrequired)
+			return false;
+	}
+
+	if (!validprogram(compiled, compiled->nfa, compiled->nnfa) || !validprogram(compiled, compiled->rnfa, compiled->nrnfa))
+		return false;
+	if (compiled->ndfastates) {
+		for (size_t c = 0; c < CHARSETLEN * 8; ++c) {
+			if (compiled->byteclass[c] >= compiled->nbyteclasses)
+				return false;
+		}
+		for (size_t i = 0; i < compiled->ndfastates * (compiled->nbyteclasses + 1); ++i) {
+			if (compiled->dfa[i] >= compiled->ndfastates && compiled->dfa[i] != DFA_MATCH && compiled->dfa[i] != DFA_DEAD)
+				return false;
+		}
+	}
+	return true;
+}
+
+static bool validgroup(const Regex* compiled, size_t pi, size_t end)
+{
+	while (pi < end) {
+		const re_Token* token = &compiled->tokens[pi];
+		if (token->type == TOKEN_END)
+			return false;
+		if (isgroup(token)) {
+			/* its END has to be before end and point back to it; what is inside it is checked on its own */
+			const re_Token* groupend = token + token->grouplen;
+			if (token->grouplen >= end - pi || groupend->type != TOKEN_END || groupend->grouplen != token->grouplen)
+				return false;
+			pi += token->grouplen;
+		}
+		++pi;
+	}
+	return true;
+}
+
+static bool validprogram(const Regex* compiled, const NfaInst* program, size_t n)
+{
+	for (size_t pc = 0; pc < n; ++pc) {
+		const NfaInst* inst = &program[pc];
+		switch (inst->op) {
+			case NFA_MATCH:
+				continue;
+			case NFA_SPLIT:
+				if (inst->x >= n || inst->y >= n)
+					return false;
+				continue;
+			case NFA_JMP:
+				if (inst->x >= n)
+					return false;
+				continue;
+			case NFA_SET:
+				if (inst->arg >= compiled->ncharsets)
+					return false;
+				break;
+			case NFA_ONE:
+				if (inst->x >= compiled->ntokens || isgroup(&compiled->tokens[inst->x]) || compiled->tokens[inst->x].type == TOKEN_END)
+					return false;
+				break;
+			case NFA_ASSERT:
+				if (inst->arg > ASSERT_NOTWORDB)
+					return false;
+				break;
+			case NFA_CHAR:
+			case NFA_SAVE:
+				/* SAVE's slot is checked against the slots asked for while matching */
+				break;
+			default:
+				return false;
+		}
+		/* the rest go on to the next instruction */
+		if (pc + 1 >= n)
+			return false;
+	}
+	return true;
+}
+
+static void compileliteral(Regex* compiled)
+{
+	compiled->nliteral = 0;
+	compiled->literalfold = false;
+	compiled->literalend = false;
+	size_t pi = compiled->anchored;
+	bool anyfold = false, anycase = false;
+	for (; pi < compiled->ntokens; ++pi) {
+		const re_Token* token = &compiled->tokens[pi];
+		if (token->quantifiermin != 1 || token->quantifiermax != 1 || token->atomic)
+			break;
+		/* non-capturing groups such as (?i:...) only change the modifiers of the chars in them */
+		if (token->type == TOKEN_GROUP || token->type == TOKEN_END)
+			continue;
+		if (token->type != TOKEN_CHAR || compiled->nliteral == MAXLITERAL)
+			break;
+		/* the chars which aren't letters match the same either way */
+		if (chartype(token->ch, CT_ALPHA)) {
+			if (token->modifiers & MOD_I)
+				anyfold = true;
+			else
+				anycase = true;
+		}
+		/* the tokens that ignore case are already folded */
+		compiled->literal[compiled->nliteral++] = token->ch;
+	}
+	if (pi + 1 == compiled->ntokens) {
+		const re_Token* last = &compiled->tokens[pi];
+		if (last->type == TOKEN_METACHAR && metachars[last->meta].pattern == '$' && last->quantifiermin == 1 && last->quantifiermax == 1) {
+			compiled->literalend = true;
+			++pi;
+		}
+	}
+	if (pi != compiled->ntokens || (anyfold && anycase)) {
+		/* something else is in the regex, or only some of its letters ignore case */
+		compiled->nliteral = 0;
+		compiled->literalend = false;
+		return;
+	}
+	compiled->literalfold = anyfold;
+}
+
+static size_t compiletokens(const char* pattern, CompileState* state)
+{
+	re_Token scratch; /* the token being counted, when the tokens aren't stored */
+	re_Token* prev = NULL;
 	size_t pi = 0; /* index into pattern  */
 	size_t ri = 0; /* index into compiled */
 
-	while (pattern[pi] != '\0' && ri < MAXTOKENS) {
-		errno = 0;
-		if (!ri) compiled->tokens[ri].modifiers = 0;
-		else     compiled->tokens[ri].modifiers = compiled->tokens[ri-1].modifiers;
-		pi += compileone(&compiled->tokens[ri], &pattern[pi], compiled->cclbuf, &compiled->ccli);
+	errno = 0;
+	while (pattern[pi] != '\0') {
+		if (state->tokens && ri + 1 >= state->maxtokens) {
+			/* regex is too large */
+			errno = ENOBUFS;
+			return ri;
+		}
+		re_Token* token = state->tokens ? &state->tokens[ri] : &scratch;
+		/* a lookbehind only looks backwards itself; the tokens in it match forwards */
+		token->modifiers = prev ? prev->modifiers & ~MOD_B : 0;
+		token->charset = NOCHARSET;
+		pi += compileone(token, &pattern[pi], state);
 		if (errno)
-			return;
+			return ri;
 	
-		pi += compilequantifier(&compiled->tokens[ri], &pattern[pi]);
+		pi += compilequantifier(token, &pattern[pi]);
 		if (errno)
-			return;
-		pi += compilegreedy(&compiled->tokens[ri], &pattern[pi]);
+			return ri;
+		pi += compilegreedy(token, &pattern[pi]);
 		if (errno)
-			return;
-		pi += compileatomic(&compiled->tokens[ri], &pattern[pi]);
+			return ri;
+		pi += compileatomic(token, &pattern[pi]);
 		if (errno)
-			return;
+			return ri;
 		
-		if (compiled->tokens[ri].type == TOKEN_END) {
-			compiled->tokens[ri - compiled->tokens[ri].grouplen].quantifiermin = compiled->tokens[ri].quantifiermin;
-			compiled->tokens[ri - compiled->tokens[ri].grouplen].quantifiermax = compiled->tokens[ri].quantifiermax;
-			compiled->tokens[ri - compiled->tokens[ri].grouplen].atomic        = compiled->tokens[ri].atomic;
-			compiled->tokens[ri - compiled->tokens[ri].grouplen].greedy        = compiled->tokens[ri].greedy;
+		if (state->tokens && token->type == TOKEN_END) {
+			re_Token* group = token - token->grouplen;
+			/* the modifiers of a group end with it, so the tokens after it have those from before it */
+			token->modifiers = group > state->tokens ? group[-1].modifiers & ~MOD_B : 0;
+			group->quantifiermin = token->quantifiermin;
+			group->quantifiermax = token->quantifiermax;
+			group->atomic        = token->atomic;
+			group->greedy        = token->greedy;
 		}
 
+		prev = token;
 		++ri;
 	}
-	if (ri == MAXTOKENS) {
-		/* regex is too large */
-		errno = ENOBUFS;
-		return;
-	}
-	/* indicate the end of the regex */
-	compiled->tokens[ri].type = TOKEN_END;
-	compiled->tokens[ri].grouplen = SIZE_MAX;
-
-	if (groupstacki)
+	if (state->depth) {
 		errno = EINVAL;
+		return ri;
+	}
+	if (state->tokens) {
+		/* indicate the end of the regex */
+		state->tokens[ri].type = TOKEN_END;
+		state->tokens[ri].grouplen = UINT32_MAX;
+	}
+	return ri;
 }
 
-static size_t compileone(re_Token* compiled, const char* pattern, ClassChar cclbuf[CCLBUFLEN], size_t* ccli)
+static size_t compileone(re_Token* compiled, const char* pattern, CompileState* state)
 {
 	size_t i;
 	switch (pattern[0]) {
@@ -233,7 +1281,7 @@ static size_t compileone(re_Token* compiled, const char* pattern, ClassChar cclb
 		case '[':
 			/* character class */
 			compiled->type = TOKEN_CHARCLASS;
-			compiled->ccl = &cclbuf[*ccli];
+			compiled->ccl = state->ccli;
 			i = 1;
 			if (pattern[i] == '^') {
 				++i;
@@ -241,30 +1289,35 @@ static size_t compileone(re_Token* compiled, const char* pattern, ClassChar cclb
 			}
 			while (pattern[i] && pattern[i] != ']') {
 				errno = 0;
-				if (*ccli >= CCLBUFLEN) {
+				if (state->cclbuf && state->ccli >= state->cclbuflen) {
 					/* buffer is too small */
 					errno = ENOBUFS; /* technically, this errno code refers to buffer space in a file stream, but I think it is still appropriate */
 					return 0;
 				}
-				i += compileoneclc(&cclbuf[*ccli], pattern+i);
+				ClassChar scratch;
+				ClassChar* clc = state->cclbuf ? &state->cclbuf[state->ccli] : &scratch;
+				i += compileoneclc(clc, pattern+i);
 				if (errno)
 					return 0;
-				i += compilerange(&cclbuf[*ccli], pattern+i);
+				i += compilerange(clc, pattern+i);
 				if (errno)
 					return 0;
-				++*ccli;
+				++state->ccli;
 			}
 			if (!pattern[i]) {
 				/* invalid regex, doesn't close the [ */
 				errno = EINVAL;
 				return 0;
 			}
-			if (*ccli >= CCLBUFLEN) {
-				/* buffer is too small for null terminator */
-				errno = ENOBUFS;
-				return 0;
+			if (state->cclbuf) {
+				if (state->ccli >= state->cclbuflen) {
+					/* buffer is too small for null terminator */
+					errno = ENOBUFS;
+					return 0;
+				}
+				state->cclbuf[state->ccli].type = CCL_END;
 			}
-			cclbuf[(*ccli)++].type = CCL_END;
+			++state->ccli;
 			return i+1;
 		case '(':
 			/* group, cgroup, lookahead or inverted lookahead */
@@ -310,23 +1363,27 @@ modifierfound:
 				++i;
 			}
 
-			if (groupstacki >= MAXGROUPS) {
-				errno = ENOBUFS;
-				return 0;
-			}
-			groupstack[groupstacki] = compiled;
-			++groupstacki;
+			/* the group is still open until its END sets grouplen */
+			compiled->grouplen = 0;
+			++state->depth;
 
 			return i;
 		case ')':
 			/* group end */
 			compiled->type = TOKEN_END;
-			if (!groupstacki) {
+			if (!state->depth) {
 				errno = EINVAL;
 				return 0;
 			}
-			--groupstacki;
-			compiled->grouplen = groupstack[groupstacki]->grouplen = compiled-groupstack[groupstacki];
+			--state->depth;
+			if (state->tokens) {
+				/* the innermost open group is the last group token before this one that hasn't been ended yet */
+				re_Token* group = compiled;
+				do
+					--group;
+				while (!(group->type == TOKEN_GROUP || group->type == TOKEN_CGROUP || group->type == TOKEN_LOOKAROUND || group->type == TOKEN_INVLOOKAROUND) || group->grouplen);
+				compiled->grouplen = group->grouplen = compiled - group;
+			}
 			return 1;
 		case '\0':
 			/* shouldn't happen */
@@ -456,6 +1513,11 @@ static size_t compilequantifier(re_Token* compiled, const char* pattern)
 	compiled->quantifiermin = 0;
 	for (i = 1; pattern[i]; ++i) {
 		if (isdigit(pattern[i])) {
+			if (compiled->quantifiermin > (QUANTIFIERMAX - 1 - (pattern[i] - '0')) / 10) {
+				/* QUANTIFIERMAX stands for no limit, so no count can be as large */
+				errno = EINVAL;
+				return 0;
+			}
 			compiled->quantifiermin *= 10;
 			compiled->quantifiermin += pattern[i] - '0';
 		} else if (pattern[i] == ',') {
@@ -481,6 +1543,11 @@ static size_t compilequantifier(re_Token* compiled, const char* pattern)
 	compiled->quantifiermax = 0;
 	for (; pattern[i]; ++i) {
 		if (isdigit(pattern[i])) {
+			if (compiled->quantifiermax > (QUANTIFIERMAX - 1 - (pattern[i] - '0')) / 10) {
+				/* QUANTIFIERMAX stands for no limit, so no count can be as large */
+				errno = EINVAL;
+				return 0;
+			}
 			compiled->quantifiermax *= 10;
 			compiled->quantifiermax += pattern[i] - '0';
 		} else if (pattern[i] == '}') {
@@ -524,358 +1591,2611 @@ static size_t compileatomic(re_Token* compiled, const char* pattern)
 	}
 }
 
-/*
- * MATCHING FUNCTIONS
- */
-
-size_t re_match(Regex pattern, const char* text, size_t* length)
+static bool compilefirstchars(const Regex* compiled, size_t pi, unsigned char firstchars[CHARSETLEN])
 {
-	for (size_t i = 0; i == 0 || text[i-1]; ++i) {
-		errno = 0;
-		size_t positions[MAXTOKENS];
-		Quantifier counts[MAXTOKENS];
-		for (size_t j = 0; j < MAXTOKENS; ++j)
-			counts[j] = pattern.tokens[j].greedy ? pattern.tokens[j].quantifiermax : pattern.tokens[j].quantifiermin;
-		const size_t lengthBuf = matchpattern(pattern.tokens, positions, counts, 0, text, i);
-		if (!errno) {
-			/* first successful match */
-			if (length)
-				*length = lengthBuf;
-			return i;
+	for (; compiled->tokens[pi].type != TOKEN_END; ++pi) {
+		const re_Token* token = &compiled->tokens[pi];
+		bool canbeempty = token->quantifiermin == 0;
+
+		if (token->quantifiermax == 0 || token->type == TOKEN_LOOKAROUND || token->type == TOKEN_INVLOOKAROUND || iszerowidth(token)) {
+			/* doesn't eat anything, so the match starts with whatever comes next */
+			canbeempty = true;
+		} else if (token->type == TOKEN_GROUP || token->type == TOKEN_CGROUP) {
+			if (compilefirstchars(compiled, pi+1, firstchars))
+				canbeempty = true;
+		} else {
+			/* find candidates by trying the token on every char, followed by a newline to let \R see \r\n */
+			bool contextual = false;
+			if (token->type == TOKEN_CHARCLASS || token->type == TOKEN_INVCHARCLASS) {
+				for (const ClassChar* clc = &compiled->cclbuf[token->ccl]; clc->type != CCL_END; ++clc) {
+					if (clc->type == CCL_METABSL && strchr("bBR", metabsls[clc->meta].pattern))
+						/* depends on the chars around it; don't try to be clever */
+						contextual = true;
+				}
+			}
+			for (unsigned c = 0; c <= UCHAR_MAX; ++c) {
+				const char text[2] = {(char)c, '\n'};
+				if (contextual || matchone(compiled, NULL, pi, text, 2, 0) != NOMATCH)
+					firstchars[c / CHAR_BIT] |= 1 << (c % CHAR_BIT);
+			}
 		}
+
+		if (token->type == TOKEN_GROUP || token->type == TOKEN_CGROUP || token->type == TOKEN_LOOKAROUND || token->type == TOKEN_INVLOOKAROUND)
+			pi += token->grouplen;
+		if (!canbeempty)
+			return false;
 	}
-	/* no matches */
-	errno = EINVAL;
-	return 0;
+	return true;
 }
 
-size_t re_matchg(Regex pattern, const char* text)
+static size_t tokenlength(const Regex* compiled, size_t pi)
 {
-	size_t i = 0;
-	size_t c = 0;
-	while (text[i]) {
-		size_t length = 0;
-		errno = 0;
-		i += re_match(pattern, text+i, &length);
-		if (errno)
-			return c;
-		++c;
-		i += length;
+	const re_Token* token = &compiled->tokens[pi];
+	if (token->type == TOKEN_GROUP || token->type == TOKEN_CGROUP)
+		return compilemaxlength(compiled, pi+1);
+	if (token->type == TOKEN_LOOKAROUND || token->type == TOKEN_INVLOOKAROUND || iszerowidth(token))
+		return 0;
+	if (token->type == TOKEN_METABSL && metabsls[token->meta].pattern == 'R')
+		/* \r\n */
+		return 2;
+	if (token->type == TOKEN_CHARCLASS || token->type == TOKEN_INVCHARCLASS) {
+		for (const ClassChar* clc = &compiled->cclbuf[token->ccl]; clc->type != CCL_END; ++clc) {
+			if (clc->type == CCL_METABSL && metabsls[clc->meta].pattern == 'R')
+				return 2;
+		}
 	}
-	return c;
+	return 1;
 }
 
-static size_t matchpattern(const re_Token* pattern, size_t* positions, Quantifier* counts, size_t pi, const char* text, size_t i)
+static size_t addlength(size_t total, size_t length, size_t times)
 {
-	size_t pos = i;
+	if (!length || !times)
+		return total;
+	/* QUANTIFIERMAX is as many as there can be */
+	if (total == SIZE_MAX || length == SIZE_MAX || times == QUANTIFIERMAX || length * times > SIZE_MAX - total)
+		return SIZE_MAX;
+	return total + length * times;
+}
 
-	for (; pattern[pi].type != TOKEN_END; ++pi) {
-		positions[pi] = pos;
-		pos += matchcount(pattern, positions, counts, pi, text, pos);
+static size_t tokenminlength(const Regex* compiled, size_t pi)
+{
+	const re_Token* token = &compiled->tokens[pi];
+	if (token->type == TOKEN_GROUP || token->type == TOKEN_CGROUP)
+		return compileminlength(compiled, pi+1);
+	if (token->type == TOKEN_LOOKAROUND || token->type == TOKEN_INVLOOKAROUND || iszerowidth(token))
+		return 0;
+	/* everything else, even \R, eats at least one char */
+	return 1;
+}
 
-		while (counts[pi] < pattern[pi].quantifiermin) {
-			errno = 0;
-			pi = backtrack(pattern, counts, pi);
-			if (errno)
-				return 0;
+static size_t compileminlength(const Regex* compiled, size_t pi)
+{
+	size_t total = 0;
+	for (; compiled->tokens[pi].type != TOKEN_END; ++pi) {
+		const size_t length = tokenminlength(compiled, pi);
+		const size_t times = compiled->tokens[pi].quantifiermin;
+		/* no text is longer than SIZE_MAX chars, so a regex that needs more can't match anyway */
+		total = length && times > (SIZE_MAX - total) / length ? SIZE_MAX : total + length * times;
+		if (isgroup(&compiled->tokens[pi]))
+			pi += compiled->tokens[pi].grouplen;
+	}
+	return total;
+}
 
-			pos = positions[pi];
-			pos += matchcount(pattern, positions, counts, pi, text, pos);
-		}
-		if (pattern[pi].type == TOKEN_GROUP || pattern[pi].type == TOKEN_CGROUP || pattern[pi].type == TOKEN_LOOKAROUND || pattern[pi].type == TOKEN_INVLOOKAROUND)
-			pi += pattern[pi].grouplen;
+static size_t compilemaxlength(const Regex* compiled, size_t pi)
+{
+	size_t total = 0;
+	for (; compiled->tokens[pi].type != TOKEN_END; ++pi) {
+		total = addlength(total, tokenlength(compiled, pi), compiled->tokens[pi].quantifiermax);
+		if (isgroup(&compiled->tokens[pi]))
+			pi += compiled->tokens[pi].grouplen;
 	}
-	errno = 0;
-	return pos-i;
+	return total;
 }
 
-static size_t backtrack(const re_Token* pattern, Quantifier* counts, size_t pi)
+static void compilerequired(Regex* compiled)
 {
-	while (pi--) {
-		if (pattern[pi].type == TOKEN_GROUP || pattern[pi].type == TOKEN_CGROUP || pattern[pi].type == TOKEN_LOOKAROUND || pattern[pi].type == TOKEN_INVLOOKAROUND) {
-			errno = EINVAL;
-			return 0;
-		}
-		if (pattern[pi].type == TOKEN_END) {
-			const size_t endpi = pi;
-			pi -= pattern[pi].grouplen;
-			if (pattern[pi].type == TOKEN_LOOKAROUND || pattern[pi].type == TOKEN_INVLOOKAROUND || pattern[pi].atomic)
-				continue;
+	RequiredState state = {.best = {.n = 0}};
+	compiled->nrequired = 0;
+	/* a plain string is searched for directly anyway */
+	if (compiled->nliteral)
+		return;
+	requiredscan(compiled, 0, &state);
+	endrequired(&state);
+	if (!state.best.n)
+		return;
 
-			errno = 0;
-			backtrack(pattern, counts, endpi);
-			if (!errno)
-				return pi;
-		}
-		if (!pattern[pi].atomic && pattern[pi].greedy && counts[pi] > pattern[pi].quantifiermin) {
-			--counts[pi];
-			for (size_t j = pi+1; j < MAXTOKENS; ++j)
-				counts[j] = pattern[j].greedy ? pattern[j].quantifiermax : pattern[j].quantifiermin;
-			errno = 0;
-			return pi;
-		} else if (!pattern[pi].atomic && !pattern[pi].greedy && counts[pi] < pattern[pi].quantifiermax) {
-			++counts[pi];
-			for (size_t j = pi+1; j < MAXTOKENS; ++j)
-				counts[j] = pattern[j].greedy ? pattern[j].quantifiermax : pattern[j].quantifiermin;
-			errno = 0;
-			return pi;
+	memcpy(compiled->required, state.best.chars, state.best.n);
+	compiled->nrequired = state.best.n;
+	compiled->requiredfold = state.best.fold;
+	compiled->requiredoffset = state.best.offset;
+	/* how far the search can move on when the char under the end of the string is c: to the last c in the rest of it */
+	memset(compiled->requiredskip, (int)state.best.n, sizeof(compiled->requiredskip));
+	for (size_t k = 0; k + 1 < state.best.n; ++k)
+		compiled->requiredskip[(unsigned char)state.best.chars[k]] = (unsigned char)(state.best.n - 1 - k);
+}
+
+static void requiredscan(const Regex* compiled, size_t pi, RequiredState* state)
+{
+	for (; compiled->tokens[pi].type != TOKEN_END; ++pi) {
+		const re_Token* token = &compiled->tokens[pi];
+		const size_t length = tokenlength(compiled, pi);
+		if (!length || !token->quantifiermax) {
+			/* eats nothing, so the chars on either side are next to each other */
+		} else if ((token->type == TOKEN_GROUP || token->type == TOKEN_CGROUP) && token->quantifiermin == 1 && token->quantifiermax == 1) {
+			/* the tokens in the group are matched once, as if they weren't in a group */
+			requiredscan(compiled, pi+1, state);
+		} else if (token->type == TOKEN_GROUP || token->type == TOKEN_CGROUP) {
+			endrequired(state);
+			/* the strings needed by the first time round are needed, but what comes before and after the group isn't next to them */
+			const size_t before = state->before;
+			if (token->quantifiermin > 0) {
+				requiredscan(compiled, pi+1, state);
+				endrequired(state);
+			}
+			state->before = addlength(before, length, token->quantifiermax);
+		} else if (token->type == TOKEN_CHAR && token->quantifiermin > 0) {
+			const bool letter = chartype(token->ch, CT_ALPHA);
+			const bool fold = letter && (token->modifiers & MOD_I);
+			/* the string can only ignore the case of all of its letters or of none of them */
+			if (letter && (fold ? state->run.exact : state->run.fold))
+				endrequired(state);
+			for (size_t k = 0; k < token->quantifiermin; ++k) {
+				if (state->run.n == MAXLITERAL)
+					endrequired(state);
+				if (!state->run.n)
+					state->run.offset = state->before;
+				state->run.chars[state->run.n++] = token->ch;
+				state->run.fold |= fold;
+				state->run.exact |= letter && !fold;
+				state->before = addlength(state->before, 1, 1);
+			}
+			if (token->quantifiermax != token->quantifiermin) {
+				/* the chars after it may be further on */
+				endrequired(state);
+				state->before = addlength(state->before, 1, token->quantifiermax == QUANTIFIERMAX ? QUANTIFIERMAX : token->quantifiermax - token->quantifiermin);
+			}
+		} else {
+			endrequired(state);
+			state->before = addlength(state->before, length, token->quantifiermax);
 		}
+		if (isgroup(token))
+			pi += token->grouplen;
 	}
-	/* all backtracking has been done, fail */
-	errno = EINVAL;
-	return 0;
 }
 
-static size_t matchcount(const re_Token* pattern, size_t* positions, Quantifier* counts, size_t pi, const char* text, size_t i)
+static void endrequired(RequiredState* state)
 {
-	const size_t oldi = i;
+	if (state->run.n > state->best.n)
+		state->best = state->run;
+	state->run.n = 0;
+	state->run.fold = false;
+	state->run.exact = false;
+}
 
-	for (Quantifier c = 0; c < counts[pi]; ++c) {
-		errno = 0;
-		i += matchone(pattern, positions, counts, pi, text, i);
-		if (errno) {
-			counts[pi] = c;
-			return i-oldi;
+static void compilefolds(Regex* compiled)
+{
+	for (size_t pi = 0; pi < compiled->ntokens; ++pi) {
+		re_Token* token = &compiled->tokens[pi];
+		if (!(token->modifiers & MOD_I))
+			continue;
+		if (token->type == TOKEN_CHAR) {
+			token->ch = foldcase(token->ch);
+		} else if (token->type == TOKEN_CHARCLASS || token->type == TOKEN_INVCHARCLASS) {
+			for (ClassChar* clc = &compiled->cclbuf[token->ccl]; clc->type != CCL_END; ++clc) {
+				if (clc->type == CCL_CHARRANGE) {
+					clc->first = foldcase(clc->first);
+					clc->last = foldcase(clc->last);
+				}
+			}
 		}
 	}
-	return i-oldi;
 }
 
-static size_t matchone(const re_Token* pattern, size_t* positions, Quantifier* counts, size_t pi, const char* text, size_t i)
+static void compilecharsets(Regex* compiled)
 {
-	size_t chars;
-	size_t ccli;
-	switch (pattern[pi].type) {
-		case TOKEN_CGROUP:
-			/* TODO capturing */
-			/* FALLTHROUGH */
-		case TOKEN_GROUP:
-			return matchpattern(pattern, positions, counts, pi+1, text, i);
-		case TOKEN_LOOKAROUND:
-			matchpattern(pattern, positions, counts, pi+1, text, i);
-			return 0;
-		case TOKEN_INVLOOKAROUND:
-			matchpattern(pattern, positions, counts, pi+1, text, i);
-			if (errno == EINVAL)
-				errno = 0;
-			else if (!errno)
-				errno = EINVAL;
-			return 0;
-		case TOKEN_METABSL:
-			errno = 0;
-			chars = metabsls[pattern[pi].meta].validator(text, i, pattern[pi].modifiers);
-			if (errno)
-				return 0;
-			return chars;
-		case TOKEN_METACHAR:
-			errno = 0;
-			chars = metachars[pattern[pi].meta].validator(text, i, pattern[pi].modifiers);
-			if (errno)
-				return 0;
-			return chars;
-		case TOKEN_CHARCLASS:
-			ccli = 0;
-			while (pattern[pi].ccl[ccli].type != CCL_END) {
-				errno = 0;
-				i += matchoneclc(pattern[pi].ccl[ccli], text, i, pattern[pi].modifiers);
-				if (!errno)
-					return 1;
-				++ccli;
-			}
-			/* all the chars in the class failed; matching failed */
-			errno = EINVAL;
-			return 0;
+	compiled->ncharsets = 0;
+	/* the tokens that can repeat go first, as a run of them is measured at once with a charset but one char at a time without */
+	for (size_t pi = 0; pi < compiled->ntokens; ++pi) {
+		if (compiled->tokens[pi].quantifiermax > 1)
+			compilecharset(compiled, pi);
+	}
+	for (size_t pi = 0; pi < compiled->ntokens; ++pi) {
+		if (compiled->tokens[pi].quantifiermax <= 1)
+			compilecharset(compiled, pi);
+	}
+}
+
+static void compilecharset(Regex* compiled, size_t pi)
+{
+	re_Token* token = &compiled->tokens[pi];
+	switch (token->type) {
+		case TOKEN_CHARCLASS: /* FALLTHROUGH */
 		case TOKEN_INVCHARCLASS:
-			if (!text[i]) {
-				errno = EINVAL;
-				return 0;
-			}
-			ccli = 0;
-			while (pattern[pi].ccl[ccli].type != CCL_END) {
-				errno = 0;
-				i += matchoneclc(pattern[pi].ccl[ccli], text, i, pattern[pi].modifiers);
-				if (!errno) {
-					/* matchoneclc succeeded; fail the charclass */
-					errno = EINVAL;
-					return 0;
-				}
-				++ccli;
+			for (const ClassChar* clc = &compiled->cclbuf[token->ccl]; clc->type != CCL_END; ++clc) {
+				if (clc->type == CCL_METABSL && strchr("bBR", metabsls[clc->meta].pattern))
+					/* depends on the chars around it, so it can't be a charset */
+					return;
 			}
-			/* all the chars in the class failed; matching succeeded */
-			errno = 0;
-			return 1;
+			break;
+		case TOKEN_METABSL:
+			if (strchr("bBR", metabsls[token->meta].pattern))
+				return;
+			break;
+		case TOKEN_METACHAR:
+			if (metachars[token->meta].pattern != '.')
+				return;
+			break;
 		case TOKEN_CHAR:
-			if (
-				( (pattern[pi].modifiers & MOD_I) && tolower(pattern[pi].ch) != tolower(text[i])) ||
-				(!(pattern[pi].modifiers & MOD_I) &&         pattern[pi].ch  !=         text[i] )
-			) {
-				errno = EINVAL;
-				return 0;
-			}
-			return 1;
+			break;
 		default:
-			/* unknown re_Token type: should never happen */
-			errno = EINVAL;
-			return 0;
+			return;
 	}
-	/* UNREACHABLE */
+
+	/* work out the set by trying the token on every char */
+	CharSet set = {{0}, 0, {0}, {0}};
+	for (unsigned c = 0; c <= UCHAR_MAX; ++c) {
+		const char text[1] = {(char)c};
+		if (matchone(compiled, NULL, pi, text, 1, 0) != NOMATCH)
+			set.map[c / CHAR_BIT] |= 1 << (c % CHAR_BIT);
+	}
+	compileranges(&set);
+
+	/* tokens with the same set share it */
+	size_t seti;
+	for (seti = 0; seti < compiled->ncharsets; ++seti) {
+		if (!memcmp(compiled->charsets[seti].map, set.map, sizeof(set.map)))
+			break;
+	}
+	if (seti == compiled->ncharsets) {
+		if (compiled->ncharsets >= MAXCHARSETS)
+			/* out of room; the token is matched the slow way */
+			return;
+		compiled->charsets[compiled->ncharsets++] = set;
+	}
+	token->charset = seti;
 }
 
-static size_t matchoneclc(ClassChar pattern, const char* text, size_t i, Modifiers modifiers)
+static void compileranges(CharSet* set)
 {
-	/* this function always returns 1 */
-	switch (pattern.type) {
-		case CCL_METABSL:
-			errno = 0;
-			metabsls[pattern.meta].validator(text, i, modifiers);
-			if (errno)
-				return 0;
-			return 1;
-		case CCL_CHARRANGE:
-			if (
-				( (modifiers & MOD_I) && (tolower(text[i]) < tolower(pattern.first) || tolower(text[i]) > tolower(pattern.last))) ||
-				(!(modifiers & MOD_I) && (        text[i]  <         pattern.first  ||         text[i]  >         pattern.last ))
-			) {
-				errno = EINVAL;
-				return 0;
-			}
-			return 1;
-		default:
-			/* should never happen */
-			errno = EINVAL;
-			return 0;
+	set->nranges = 0;
+	for (unsigned c = 0; c <= UCHAR_MAX; ++c) {
+		if (!inset(set, (char)c))
+			continue;
+		if (set->nranges >= MAXCHARSETRANGES) {
+			/* too many ranges, so the bitmap has to be used */
+			set->nranges = 0;
+			return;
+		}
+		set->first[set->nranges] = c;
+		while (c < UCHAR_MAX && inset(set, (char)(c+1)))
+			++c;
+		set->last[set->nranges] = c;
+		++set->nranges;
 	}
-	/* UNREACHABLE */
 }
 
-size_t matchwhitespace(const char* text, size_t i, Modifiers modifiers)
+static size_t capturenumber(const Regex* compiled, size_t pi)
 {
-	UNUSED(modifiers);
-	if (!isspace(text[i])) {
-		errno = EINVAL;
-		return 0;
+	size_t n = 0;
+	for (size_t i = 0; i <= pi && i < compiled->ntokens; ++i) {
+		if (compiled->tokens[i].type == TOKEN_CGROUP)
+			++n;
 	}
-	return 1;
+	return n;
 }
-size_t matchnotwhitespace(const char* text, size_t i, Modifiers modifiers)
+
+static bool isgroup(const re_Token* token)
 {
-	UNUSED(modifiers);
-	if (!text[i] || isspace(text[i])) {
-		errno = EINVAL;
-		return 0;
+	return token->type == TOKEN_GROUP || token->type == TOKEN_CGROUP || token->type == TOKEN_LOOKAROUND || token->type == TOKEN_INVLOOKAROUND;
+}
+
+static bool isloop(const re_Token* token)
+{
+	return token->type == TOKEN_GROUP || token->type == TOKEN_CGROUP || (token->type == TOKEN_METABSL && metabsls[token->meta].pattern == 'R');
+}
+
+static bool iszerowidth(const re_Token* token)
+{
+	if (token->type == TOKEN_METABSL)
+		return metabsls[token->meta].pattern == 'b' || metabsls[token->meta].pattern == 'B';
+	if (token->type == TOKEN_METACHAR)
+		return metachars[token->meta].pattern != '.';
+	return false;
+}
+
+static void compilenfa(Regex* compiled)
+{
+	const re_Token* first = &compiled->tokens[0];
+	compiled->anchored = first->type == TOKEN_METACHAR && metachars[first->meta].pattern == '^' && first->quantifiermin > 0;
+
+	compiled->nnfa = 0;
+	compiled->ndfastates = 0;
+	compiled->nrnfa = 0;
+	if (compiled->ntokens > MAXNFATOKENS || compiled->ccli > MAXNFACCL)
+		/* compilesize works out the size of the automata in buffers of these sizes */
+		return;
+	if (!emitnfa(compiled, 0, false) || !emitnfainst(compiled, NFA_MATCH, 0, 0, 0)) {
+		/* the backtracker has to be used */
+		compiled->nnfa = 0;
+		return;
 	}
-	return 1;
+	compiledfa(compiled);
+	compilebackward(compiled);
 }
-size_t matchdigit(const char* text, size_t i, Modifiers modifiers)
+
+static void compilebackward(Regex* compiled)
 {
-	UNUSED(modifiers);
-	if (!isdigit(text[i])) {
-		errno = EINVAL;
-		return 0;
+	if (!compiled->ntokens || compiled->anchored)
+		return;
+	const re_Token* last = &compiled->tokens[compiled->ntokens - 1];
+	if (last->type != TOKEN_METACHAR || metachars[last->meta].pattern != '$' || last->quantifiermin == 0)
+		return;
+	/* the emit functions write to nfa, so the forward program is put aside while the backward one is emitted */
+	NfaInst forward[MAXNFA];
+	const size_t nforward = compiled->nnfa;
+	memcpy(forward, compiled->nfa, nforward * sizeof(forward[0]));
+	compiled->nnfa = 0;
+	if (emitnfa(compiled, 0, true) && emitnfainst(compiled, NFA_MATCH, 0, 0, 0)) {
+		memcpy(compiled->rnfa, compiled->nfa, compiled->nnfa * sizeof(compiled->rnfa[0]));
+		compiled->nrnfa = compiled->nnfa;
 	}
-	return 1;
+	memcpy(compiled->nfa, forward, nforward * sizeof(forward[0]));
+	compiled->nnfa = nforward;
 }
-size_t matchnotdigit(const char* text, size_t i, Modifiers modifiers)
+
+static bool emitnfa(Regex* compiled, size_t pi, bool reverse)
 {
-	UNUSED(modifiers);
-	if (!text[i] || isdigit(text[i])) {
-		errno = EINVAL;
-		return 0;
+	if (!reverse) {
+		for (; compiled->tokens[pi].type != TOKEN_END; ++pi) {
+			if (!emitnfaquantified(compiled, pi, reverse))
+				return false;
+			if (compiled->tokens[pi].type == TOKEN_GROUP || compiled->tokens[pi].type == TOKEN_CGROUP)
+				pi += compiled->tokens[pi].grouplen;
+		}
+		return true;
 	}
-	return 1;
+	/* find the END, then go back over the tokens, jumping from the END of each group to its start */
+	size_t end = pi;
+	while (compiled->tokens[end].type != TOKEN_END)
+		end += isgroup(&compiled->tokens[end]) ? compiled->tokens[end].grouplen + 1 : 1;
+	while (end > pi) {
+		--end;
+		if (compiled->tokens[end].type == TOKEN_END)
+			end -= compiled->tokens[end].grouplen;
+		if (!emitnfaquantified(compiled, end, reverse))
+			return false;
+	}
+	return true;
 }
-size_t matchwordchar(const char* text, size_t i, Modifiers modifiers)
+
+static bool emitnfaquantified(Regex* compiled, size_t pi, bool reverse)
 {
-	UNUSED(modifiers);
-	if (!iswordchar(text[i])) {
-		errno = EINVAL;
-		return 0;
+	const re_Token* token = &compiled->tokens[pi];
+	if (token->atomic)
+		/* the NFA can't refuse to give characters back */
+		return false;
+
+	/* the required repetitions */
+	for (size_t c = 0; c < token->quantifiermin; ++c) {
+		if (!emitnfaone(compiled, pi, reverse))
+			return false;
 	}
-	return 1;
+
+	if (token->quantifiermax == QUANTIFIERMAX) {
+		/* any number of extra repetitions: loop: SPLIT body, out; body; JMP loop */
+		const size_t loop = compiled->nnfa;
+		if (!emitnfainst(compiled, NFA_SPLIT, 0, 0, 0) || !emitnfaone(compiled, pi, reverse) || !emitnfainst(compiled, NFA_JMP, 0, loop, 0))
+			return false;
+		patchnfasplit(compiled, loop, token->greedy);
+		return true;
+	}
+
+	/* up to max-min optional repetitions, each one skipping to the end if it isn't taken; each takes an instruction, so there are at most MAXNFA */
+	uint16_t splits[MAXNFA];
+	size_t nsplits = 0;
+	for (size_t c = token->quantifiermin; c < token->quantifiermax; ++c) {
+		splits[nsplits++] = compiled->nnfa;
+		if (!emitnfainst(compiled, NFA_SPLIT, 0, 0, 0) || !emitnfaone(compiled, pi, reverse))
+			return false;
+	}
+	while (nsplits--) {
+		compiled->nfa[splits[nsplits]].x = splits[nsplits] + 1;
+		compiled->nfa[splits[nsplits]].y = compiled->nnfa;
+		patchnfasplit(compiled, splits[nsplits], token->greedy);
+	}
+	return true;
 }
-size_t matchnotwordchar(const char* text, size_t i, Modifiers modifiers)
+
+static void patchnfasplit(Regex* compiled, size_t split, bool greedy)
 {
-	UNUSED(modifiers);
-	if (!text[i] || iswordchar(text[i])) {
-		errno = EINVAL;
-		return 0;
+	/* the body starts right after the SPLIT and everything after it starts at the end of the program so far */
+	compiled->nfa[split].x = greedy ? split + 1       : compiled->nnfa;
+	compiled->nfa[split].y = greedy ? compiled->nnfa  : split + 1;
+}
+
+static bool emitnfaone(Regex* compiled, size_t pi, bool reverse)
+{
+	const re_Token* token = &compiled->tokens[pi];
+	size_t split;
+
+	switch (token->type) {
+		case TOKEN_GROUP:
+			return emitnfa(compiled, pi+1, reverse);
+		case TOKEN_CGROUP:
+			/* the backward program is only used when no groups are asked for */
+			if (reverse)
+				return emitnfa(compiled, pi+1, reverse);
+			/* the start and end of the group go in slots 2n-2 and 2n-1 */
+			split = 2 * (capturenumber(compiled, pi) - 1);
+			return emitnfainst(compiled, NFA_SAVE, 0, split, 0) && emitnfa(compiled, pi+1, reverse) && emitnfainst(compiled, NFA_SAVE, 0, split+1, 0);
+		case TOKEN_METACHAR:
+			switch (metachars[token->meta].pattern) {
+				case '^':
+					return emitnfainst(compiled, NFA_ASSERT, ASSERT_START, 0, 0);
+				case '$':
+					return emitnfainst(compiled, NFA_ASSERT, ASSERT_END, 0, 0);
+				default:
+					break;
+			}
+			break;
+		case TOKEN_METABSL:
+			switch (metabsls[token->meta].pattern) {
+				case 'b':
+					return emitnfainst(compiled, NFA_ASSERT, ASSERT_WORDB, 0, 0);
+				case 'B':
+					return emitnfainst(compiled, NFA_ASSERT, ASSERT_NOTWORDB, 0, 0);
+				case 'R':
+					/* SPLIT crlf, lf; crlf: \r \n JMP end; lf: \n; end: (with \n \r backwards) */
+					split = compiled->nnfa;
+					if (
+						!emitnfainst(compiled, NFA_SPLIT, 0, split+1, split+4) ||
+						!emitnfainst(compiled, NFA_CHAR, reverse ? '\n' : '\r', 0, 0) ||
+						!emitnfainst(compiled, NFA_CHAR, reverse ? '\r' : '\n', 0, 0) ||
+						!emitnfainst(compiled, NFA_JMP, 0, split+5, 0) ||
+						!emitnfainst(compiled, NFA_CHAR, '\n', 0, 0)
+					)
+						return false;
+					return true;
+				default:
+					break;
+			}
+			break;
+		case TOKEN_LOOKAROUND: /* FALLTHROUGH */
+		case TOKEN_INVLOOKAROUND:
+			/* the NFA has no way to look ahead */
+			return false;
+		default:
+			break;
 	}
-	return 1;
+
+	/* a token that eats one char */
+	if (token->charset != NOCHARSET)
+		return emitnfainst(compiled, NFA_SET, token->charset, 0, 0);
+	return emitnfainst(compiled, NFA_ONE, 0, pi, 0);
 }
-size_t matchnewline(const char* text, size_t i, Modifiers modifiers)
+
+static bool emitnfainst(Regex* compiled, NfaOp op, unsigned char arg, size_t x, size_t y)
 {
-	UNUSED(modifiers);
-	if (text[i] == '\r' && text[i+1] == '\n')
-		return 2;
-	else if (text[i] == '\n')
-		return 1;
-	errno = EINVAL;
-	return 0;
+	if (compiled->nnfa >= MAXNFA || x > UINT16_MAX || y > UINT16_MAX)
+		return false;
+	compiled->nfa[compiled->nnfa].op = op;
+	compiled->nfa[compiled->nnfa].arg = arg;
+	compiled->nfa[compiled->nnfa].x = x;
+	compiled->nfa[compiled->nnfa].y = y;
+	++compiled->nnfa;
+	return true;
 }
-size_t matchwordboundary(const char* text, size_t i, Modifiers modifiers)
+
+static void compiledfa(Regex* compiled)
 {
-	UNUSED(modifiers);
-	if (
-		(i > 0 && iswordchar(text[i-1]) != !iswordchar(text[i])) ||
-		(i == 0 && !iswordchar(text[0]))
-	) {
-		errno = EINVAL;
-		return 0;
+	/* the sets of chars that the program tells apart: every charset and char it eats, and word chars if it looks for word boundaries */
+	CharSet sets[MAXCHARSETS + 3];
+	size_t nsets = 0;
+	bool words = false;
+	for (size_t pc = 0; pc < compiled->nnfa; ++pc) {
+		const NfaInst* inst = &compiled->nfa[pc];
+		if (inst->op == NFA_ONE)
+			/* depends on the text around it; no DFA */
+			return;
+		if (inst->op == NFA_ASSERT && (inst->arg == ASSERT_WORDB || inst->arg == ASSERT_NOTWORDB))
+			words = true;
+	}
+	for (size_t seti = 0; seti < compiled->ncharsets; ++seti)
+		sets[nsets++] = compiled->charsets[seti];
+	memset(&sets[nsets], 0, 3 * sizeof(sets[0]));
+	for (unsigned c = 0; c <= UCHAR_MAX; ++c) {
+		if (c == '\r' || c == '\n')
+			sets[nsets + (c == '\n')].map[c / CHAR_BIT] |= 1 << (c % CHAR_BIT);
+		if (words && iswordchar(c))
+			sets[nsets + 2].map[c / CHAR_BIT] |= 1 << (c % CHAR_BIT);
+	}
+	nsets += 3;
+
+	/* split all the chars into classes of chars that are in exactly the same sets */
+	uint16_t signatures[CHARSETLEN * 8];
+	unsigned char representatives[CHARSETLEN * 8];
+	compiled->nbyteclasses = 0;
+	for (unsigned c = 0; c <= UCHAR_MAX; ++c) {
+		uint16_t signature = 0;
+		for (size_t seti = 0; seti < nsets; ++seti)
+			signature |= inset(&sets[seti], (char)c) << seti;
+		size_t classi;
+		for (classi = 0; classi < compiled->nbyteclasses; ++classi) {
+			if (signatures[classi] == signature)
+				break;
+		}
+		if (classi == compiled->nbyteclasses) {
+			signatures[classi] = signature;
+			representatives[classi] = c;
+			++compiled->nbyteclasses;
+		}
+		compiled->byteclass[c] = classi;
+	}
+	const size_t rowlen = compiled->nbyteclasses + 1;
+
+	/* subset construction, starting from the start of the text */
+	NfaSet states[MAXDFASTATES];
+	memset(&states[0], 0, sizeof(states[0]));
+	states[0].atstart = true;
+	size_t nstates = 1;
+	for (size_t si = 0; si < nstates; ++si) {
+		for (size_t classi = 0; classi < rowlen; ++classi) {
+			/* the last column is for the end of the text */
+			const bool end = classi == compiled->nbyteclasses;
+			const char c = end ? '\0' : (char)representatives[classi];
+			NfaSet next;
+			if (dfastep(compiled, &states[si], end, c, &next)) {
+				compiled->dfa[si * rowlen + classi] = DFA_MATCH;
+				continue;
+			}
+			if (end) {
+				compiled->dfa[si * rowlen + classi] = DFA_DEAD;
+				continue;
+			}
+			next.prevword = words && iswordchar(c);
+			bool empty = true;
+			for (size_t i = 0; i < sizeof(next.pcs); ++i)
+				empty &= !next.pcs[i];
+			if (empty && compiled->anchored) {
+				/* the match had to start at the start of the text */
+				compiled->dfa[si * rowlen + classi] = DFA_DEAD;
+				continue;
+			}
+
+			size_t nexti;
+			for (nexti = 0; nexti < nstates; ++nexti) {
+				if (!memcmp(&states[nexti], &next, sizeof(next)))
+					break;
+			}
+			if (nexti == nstates) {
+				if (nstates >= MAXDFASTATES || (nstates+1) * rowlen > MAXDFATRANS)
+					/* too big; only the NFA is used */
+					return;
+				states[nstates++] = next;
+			}
+			compiled->dfa[si * rowlen + classi] = nexti;
+		}
 	}
-	return 0;
+	compiled->ndfastates = nstates;
 }
-size_t matchnotwordboundary(const char* text, size_t i, Modifiers modifiers)
+
+static bool dfastep(const Regex* compiled, const NfaSet* state, bool end, char c, NfaSet* next)
 {
-	UNUSED(modifiers);
-	if (
-		(i > 0 && iswordchar(text[i-1]) == !iswordchar(text[i])) ||
-		(i == 0 && iswordchar(text[0]))
-	) {
-		errno = EINVAL;
-		return 0;
+	/* follow every zero-width instruction from the state (and from the start of the program, as a match could start here) */
+	unsigned char seen[MAXNFA / CHAR_BIT] = {0};
+	uint16_t stack[3 * MAXNFA + 1];
+	size_t stacki = 0;
+	memset(next, 0, sizeof(*next));
+
+	for (size_t pc = compiled->nnfa; pc--;) {
+		if (state->pcs[pc / CHAR_BIT] & (1 << (pc % CHAR_BIT)))
+			stack[stacki++] = pc;
+	}
+	if (!compiled->anchored || state->atstart)
+		stack[stacki++] = 0;
+
+	while (stacki) {
+		const size_t pc = stack[--stacki];
+		if (seen[pc / CHAR_BIT] & (1 << (pc % CHAR_BIT)))
+			continue;
+		seen[pc / CHAR_BIT] |= 1 << (pc % CHAR_BIT);
+
+		const NfaInst* inst = &compiled->nfa[pc];
+		bool eats = false;
+		switch (inst->op) {
+			case NFA_MATCH:
+				return true;
+			case NFA_SET:
+				eats = !end && inset(&compiled->charsets[inst->arg], c);
+				break;
+			case NFA_CHAR:
+				eats = !end && c == (char)inst->arg;
+				break;
+			case NFA_ASSERT:
+				if (matchassert(inst->arg, state->atstart, end, state->prevword, !end && iswordchar(c)))
+					stack[stacki++] = pc+1;
+				break;
+			case NFA_SPLIT:
+				stack[stacki++] = inst->y;
+				stack[stacki++] = inst->x;
+				break;
+			case NFA_JMP:
+				stack[stacki++] = inst->x;
+				break;
+			case NFA_SAVE:
+				stack[stacki++] = pc+1;
+				break;
+			default:
+				/* NFA_ONE never gets here */
+				break;
+		}
+		if (eats)
+			next->pcs[(pc+1) / CHAR_BIT] |= 1 << ((pc+1) % CHAR_BIT);
 	}
-	return 0;
+	return false;
+}
+
+/*
+ * MATCHING FUNCTIONS
+ */
+
+size_t re_match(Regex pattern, const char* text, size_t* length)
+{
+	return re_matchp(&pattern, text, length);
 }
 
-size_t matchstart(const char* text, size_t i, Modifiers modifiers)
+size_t re_matchp(const Regex* pattern, const char* text, size_t* length)
 {
-	UNUSED(text);
-	UNUSED(modifiers);
-	if (i) {
-		errno = EINVAL;
+	return re_matchn(pattern, text, strlen(text), length);
+}
+
+size_t re_matchn(const Regex* pattern, const char* text, size_t len, size_t* length)
+{
+	size_t lengthBuf;
+	Budget budget = {.maxsteps = SIZE_MAX};
+	const size_t start = search(pattern, text, len, 0, len, &lengthBuf, NULL, 0, &budget);
+	if (start == NOMATCH) {
+		errno = budget.full ? ENOBUFS : EINVAL;
 		return 0;
 	}
-	return 0;
+	errno = 0;
+	if (length)
+		*length = lengthBuf;
+	return start;
 }
-size_t matchend(const char* text, size_t i, Modifiers modifiers)
+
+size_t re_matchopts(const Regex* pattern, const char* text, size_t len, size_t* length, re_match_opts* opts)
 {
-	UNUSED(modifiers);
-	if (text[i] != '\0') {
+	size_t lengthBuf;
+	Budget budget = {.maxsteps = opts->maxsteps ? opts->maxsteps : SIZE_MAX, .deadline = opts->deadline, .work = opts->work, .worklen = opts->worklen};
+#ifdef RE_USE_STATS
+	budget.stats = opts->stats;
+#endif
+	const size_t start = search(pattern, text, len, 0, len, &lengthBuf, NULL, 0, &budget);
+	opts->steps = budget.steps;
+	if (budget.full) {
+		errno = ENOBUFS;
+		return 0;
+	}
+	if (budget.exceeded) {
+		errno = ETIMEDOUT;
+		return 0;
+	}
+	if (start == NOMATCH) {
 		errno = EINVAL;
 		return 0;
 	}
-	return 0;
+	errno = 0;
+	if (length)
+		*length = lengthBuf;
+	return start;
 }
-size_t matchany(const char* text, size_t i, Modifiers modifiers)
+
+size_t re_match_batch(const Regex* pattern, const char* const* texts, const size_t* lens, size_t n, re_result* out)
 {
-	if (text[i] == '\0' || (!(modifiers & MOD_S) && text[i] == '\n')) {
-		errno = EINVAL;
+	/* the engine and its buffers only depend on the regex, so they are the same for every text */
+	const Engine engine = searchplan(pattern, 0);
+	NfaList lists[2];
+	size_t marks[MAXNFA];
+	Scratch scratch = {lists, marks};
+	Budget budget = {.maxsteps = SIZE_MAX};
+	size_t nmatched = 0;
+	bool full = false;
+	for (size_t t = 0; t < n; ++t) {
+#ifdef __GNUC__
+		/* fetch the next text while this one is matched */
+		if (t + 1 < n)
+			__builtin_prefetch(texts[t+1]);
+#endif
+		const size_t len = lens ? lens[t] : strlen(texts[t]);
+		out[t].start = searchwith(pattern, engine, &scratch, texts[t], len, 0, len, &out[t].length, NULL, 0, &budget);
+		if (out[t].start == NOMATCH)
+			out[t].length = 0;
+		else
+			++nmatched;
+		/* a text that the backtracker ran out of room for doesn't stop the others */
+		full |= budget.full;
+		budget.full = budget.exceeded = false;
+	}
+	errno = full ? ENOBUFS : 0;
+	return nmatched;
+}
+
+size_t re_match_captures(const Regex* pattern, const char* text, size_t len, re_span* caps, size_t ncaps)
+{
+	Budget budget = {.maxsteps = SIZE_MAX};
+	const size_t start = searchcaptures(pattern, text, len, 0, caps, ncaps, &budget);
+	if (start == NOMATCH) {
+		errno = budget.full ? ENOBUFS : EINVAL;
 		return 0;
 	}
-	return 1;
+	errno = 0;
+	return start;
 }
 
-/*
- * PRINTING FUNCTIONS
- */
+void re_find_init(RegexIter* iter, const Regex* pattern, const char* text, size_t len)
+{
+	iter->pattern = pattern;
+	iter->text = text;
+	iter->len = len;
+	iter->pos = 0;
+}
 
-void re_print(Regex pattern)
+bool re_find_iter(RegexIter* iter, re_span* caps, size_t ncaps)
+{
+	if (iter->pos > iter->len)
+		return false;
+	re_span match;
+	if (!ncaps) {
+		caps = &match;
+		ncaps = 1;
+	}
+	Budget budget = {.maxsteps = SIZE_MAX};
+	const size_t start = searchcaptures(iter->pattern, iter->text, iter->len, iter->pos, caps, ncaps, &budget);
+	errno = budget.full ? ENOBUFS : 0;
+	if (start == NOMATCH) {
+		iter->pos = iter->len + 1;
+		return false;
+	}
+	/* step over empty matches so that they aren't found forever */
+	iter->pos = caps[0].start + (caps[0].length ? caps[0].length : 1);
+	return true;
+}
+
+static size_t searchcaptures(const Regex* pattern, const char* text, size_t len, size_t from, re_span* caps, size_t ncaps, Budget* budget)
+{
+	re_span match;
+	if (!ncaps) {
+		caps = &match;
+		ncaps = 1;
+	}
+	/* only the groups that are asked for are tracked */
+	const size_t ngroups = ncaps-1 < pattern->ncaptures ? ncaps-1 : pattern->ncaptures;
+	size_t length;
+	/* the engines store the spans of the groups straight after that of the match */
+	const size_t start = search(pattern, text, len, from, len, &length, caps + 1, ngroups, budget);
+	if (start == NOMATCH)
+		return NOMATCH;
+	caps[0].start = start;
+	caps[0].length = length;
+	for (size_t n = ngroups + 1; n < ncaps; ++n) {
+		caps[n].start = NOMATCH;
+		caps[n].length = 0;
+	}
+	return start;
+}
+
+static Engine searchplan(const Regex* pattern, size_t ngroups)
+{
+	if (pattern->nliteral)
+		return ENGINE_LITERAL;
+	if (pattern->nrnfa && !ngroups)
+		return ENGINE_BACKWARD;
+	if (pattern->nnfa && 2 * ngroups <= MAXNFASLOTS)
+		return ENGINE_NFA;
+	return ENGINE_BACKTRACKER;
+}
+
+static size_t search(const Regex* pattern, const char* text, size_t len, size_t from, size_t last, size_t* length, re_span* spans, size_t ngroups, Budget* budget)
+{
+	NfaList lists[2];
+	size_t marks[MAXNFA];
+	Scratch scratch = {lists, marks};
+	return searchwith(pattern, searchplan(pattern, ngroups), &scratch, text, len, from, last, length, spans, ngroups, budget);
+}
+
+static size_t searchwith(const Regex* pattern, Engine engine, Scratch* scratch, const char* text, size_t len, size_t from, size_t last, size_t* length, re_span* spans, size_t ngroups, Budget* budget)
+{
+#ifdef RE_USE_STATS
+	/* stats given to the call take the place of those of the regex */
+	if (!budget->stats)
+		budget->stats = pattern->stats;
+	re_stats* const stats = budget->stats;
+	if (stats) {
+		const uint64_t start = stats->timed ? cycles() : 0;
+		const size_t steps = budget->steps;
+		const size_t found = searchengine(pattern, engine, scratch, text, len, from, last, length, spans, ngroups, budget);
+		++stats->searches;
+		if (found != NOMATCH)
+			++stats->matches;
+		stats->steps += budget->steps - steps;
+		if (stats->timed)
+			stats->cycles += cycles() - start;
+		return found;
+	}
+#endif
+	return searchengine(pattern, engine, scratch, text, len, from, last, length, spans, ngroups, budget);
+}
+
+static size_t searchengine(const Regex* pattern, Engine engine, Scratch* scratch, const char* text, size_t len, size_t from, size_t last, size_t* length, re_span* spans, size_t ngroups, Budget* budget)
+{
+	/* every match eats at least minlength chars, so none can start after lateststart */
+	if (len - from < pattern->minlength) {
+		COUNT(budget, tooshort, 1);
+		return NOMATCH;
+	}
+	const size_t lateststart = len - pattern->minlength;
+	if (last > lateststart)
+		last = lateststart;
+	if (pattern->nrequired) {
+		/* every match has the required string in it, at most requiredoffset chars after its start */
+		const size_t n = pattern->nrequired;
+		const size_t offset = pattern->requiredoffset;
+		size_t end = len;
+		if (last < len && offset != SIZE_MAX && offset < len - last - n)
+			end = last + offset + n;
+		const size_t found = findrequired(pattern, text, end, from);
+		if (found == NOMATCH) {
+			COUNT(budget, norequired, 1);
+			return NOMATCH;
+		}
+		if (offset != SIZE_MAX && found - from > offset) {
+			from = found - offset;
+			if (from > last) {
+				COUNT(budget, norequired, 1);
+				return NOMATCH;
+			}
+		}
+	}
+	if (from && pattern->anchored)
+		return NOMATCH;
+	if (engine == ENGINE_LITERAL) {
+		/* a plain string has no groups, so there are no slots to fill */
+		COUNT(budget, literal, 1);
+		return literalsearch(pattern, text, len, from, last, length, budget);
+	}
+	if (engine == ENGINE_BACKWARD) {
+		/* every match ends at the end of the text, so it is found from there without looking at the text before it */
+		COUNT(budget, backward, 1);
+		if (last < len && pattern->maxlength < len - last)
+			return NOMATCH;
+		return nfamatchback(pattern, scratch, text, len, from, last, length, budget);
+	}
+	if (engine == ENGINE_NFA) {
+		/* no backtracking needed; most texts don't match, and the DFA finds that out quickly */
+		/* the DFA takes from as the start of the text, which can only let ^ match more, unless it is wrong about the char before from */
+		/* a match starting by last ends by last + maxlength, and the asserts there only look at one char further, so the DFA doesn't need the rest */
+		/* with no such limit, the DFA can only tell whether a match starts anywhere, which is enough if every start up to last could be one */
+		size_t end = len;
+		if (last < len)
+			end = pattern->maxlength < len - last - 1 ? last + pattern->maxlength + 1 : len;
+		if (pattern->ndfastates && (!from || !iswordchar(text[from-1])) && (last == lateststart || pattern->maxlength != SIZE_MAX) && !dfasearch(pattern, text+from, end-from)) {
+			COUNT(budget, dfarejects, 1);
+			return NOMATCH;
+		}
+		COUNT(budget, nfa, 1);
+		return nfamatch(pattern, scratch, text, len, from, last, length, spans, ngroups, budget);
+	}
+
+	COUNT(budget, backtracker, 1);
+	return backtracksearch(pattern, text, len, from, last, length, spans, ngroups, budget);
+}
+
+size_t re_matchg(Regex pattern, const char* text)
+{
+	return re_matchgp(&pattern, text);
+}
+
+size_t re_matchgp(const Regex* pattern, const char* text)
+{
+	return re_matchgn(pattern, text, strlen(text));
+}
+
+size_t re_matchgn(const Regex* pattern, const char* text, size_t len)
+{
+	RegexIter iter;
+	re_find_init(&iter, pattern, text, len);
+	size_t c = 0;
+	while (re_find_iter(&iter, NULL, 0))
+		++c;
+	return c;
+}
+
+size_t re_chunk_split(RegexChunk* chunks, size_t nchunks, const Regex* pattern, const char* text, size_t len)
+{
+	if (!nchunks)
+		return 0;
+	/* there are len+1 positions to search from, including the end */
+	if (nchunks > len + 1)
+		nchunks = len + 1;
+	for (size_t c = 0; c < nchunks; ++c) {
+		chunks[c].pattern = pattern;
+		chunks[c].text = text;
+		chunks[c].len = len;
+		chunks[c].from = (len + 1) / nchunks * c;
+		chunks[c].to = c + 1 < nchunks ? (len + 1) / nchunks * (c+1) : len + 1;
+		chunks[c].count = 0;
+		chunks[c].end = chunks[c].to;
+		chunks[c].start = chunks[c].from;
+		chunks[c].nsync = 0;
+		chunks[c].full = false;
+	}
+	return nchunks;
+}
+
+void re_chunk_match(RegexChunk* chunk)
+{
+	size_t pos = chunk->from;
+	chunk->count = 0;
+	chunk->nsync = 0;
+	chunk->full = false;
+	while (pos < chunk->to) {
+		if (chunk->nsync < MAXSYNC)
+			chunk->sync[chunk->nsync++] = pos;
+		const size_t next = chunkstep(chunk, pos);
+		if (next == NOMATCH) {
+			/* the search from pos goes on at the next chunk */
+			pos = chunk->to;
+			break;
+		}
+		++chunk->count;
+		pos = next;
+	}
+	chunk->end = pos;
+}
+
+size_t re_chunk_join(RegexChunk* chunks, size_t nchunks)
+{
+	size_t count = 0;
+	size_t pos = 0;
+	bool full = false;
+	for (size_t c = 0; c < nchunks; ++c) {
+		RegexChunk* chunk = &chunks[c];
+		chunk->start = pos < chunk->to ? pos : chunk->to;
+		/* a match over the end of the chunk before can make the search start after where this one's did; */
+		/* search again until it gets to one of the same positions, from where the rest is the same */
+		size_t s = 0;
+		while (pos < chunk->to) {
+			while (s < chunk->nsync && chunk->sync[s] < pos)
+				++s;
+			if (s < chunk->nsync && chunk->sync[s] == pos) {
+				/* sync[s] was searched from after s matches */
+				count += chunk->count - s;
+				pos = chunk->end;
+				break;
+			}
+			const size_t next = chunkstep(chunk, pos);
+			if (next == NOMATCH) {
+				pos = chunk->to;
+				break;
+			}
+			++count;
+			pos = next;
+		}
+		full |= chunk->full;
+	}
+	errno = full ? ENOBUFS : 0;
+	return count;
+}
+
+#ifdef RE_USE_PTHREADS
+static void* chunkthread(void* chunk)
+{
+	re_chunk_match(chunk);
+	return NULL;
+}
+
+size_t re_matchg_parallel(const Regex* pattern, const char* text, size_t len, size_t nthreads)
+{
+	if (!nthreads)
+		nthreads = 1;
+	else if (nthreads > MAXTHREADS)
+		nthreads = MAXTHREADS;
+	RegexChunk chunks[MAXTHREADS];
+	pthread_t threads[MAXTHREADS];
+	bool started[MAXTHREADS];
+	nthreads = re_chunk_split(chunks, nthreads, pattern, text, len);
+	/* the first chunk is matched by this thread, and so are the ones for which no thread could be started */
+	for (size_t c = 1; c < nthreads; ++c)
+		started[c] = pthread_create(&threads[c], NULL, chunkthread, &chunks[c]) == 0;
+	re_chunk_match(&chunks[0]);
+	for (size_t c = 1; c < nthreads; ++c) {
+		if (started[c])
+			pthread_join(threads[c], NULL);
+		else
+			re_chunk_match(&chunks[c]);
+	}
+	return re_chunk_join(chunks, nthreads);
+}
+#endif
+
+size_t re_set_match(const RegexSet* set, const char* text, size_t len, unsigned char* matched)
+{
+	memset(matched, 0, (set->nregexes + CHAR_BIT - 1) / CHAR_BIT);
+	size_t nmatched = 0;
+	errno = 0;
+	for (size_t b = 0; b < set->nregexes; b += SETBLOCK) {
+		const RegexSet block = {set->regexes + b, set->nregexes - b < SETBLOCK ? set->nregexes - b : SETBLOCK};
+		nmatched += setsearch(&block, text, len, matched + b / CHAR_BIT, NULL);
+	}
+	return nmatched;
+}
+
+size_t re_set_find(const RegexSet* set, const char* text, size_t len, re_span* spans)
+{
+	size_t nmatched = 0;
+	errno = 0;
+	for (size_t b = 0; b < set->nregexes; b += SETBLOCK) {
+		const RegexSet block = {set->regexes + b, set->nregexes - b < SETBLOCK ? set->nregexes - b : SETBLOCK};
+		unsigned char matched[SETBLOCK / CHAR_BIT] = {0};
+		nmatched += setsearch(&block, text, len, matched, spans + b);
+	}
+	return nmatched;
+}
+
+void re_stream_init(RegexStream* stream, const Regex* pattern)
+{
+	stream->pattern = pattern;
+	stream->pos = 0;
+	stream->matchstart = NOMATCH;
+	stream->matchend = 0;
+	stream->nseeds = 0;
+	memset(stream->marks, 0, sizeof(stream->marks));
+	/* backtracking would need the whole text */
+	errno = pattern->nnfa ? 0 : ENOTSUP;
+}
+
+bool re_stream_feed(RegexStream* stream, const char* chunk, size_t len)
+{
+	const Regex* pattern = stream->pattern;
+	for (size_t j = 0; j < len; ++j) {
+		if (!stream->nseeds) {
+			if (stream->matchstart != NOMATCH || (pattern->anchored && stream->pos))
+				/* nothing can change the result any more */
+				return true;
+			if (pattern->prefilter) {
+				/* no match is in progress, so skip to where the next one can start */
+				const size_t skip = skipfirstchars(pattern, chunk, len, j);
+				if (skip > j) {
+					stream->pos += skip - j;
+					stream->prev = chunk[skip-1];
+					j = skip;
+				}
+				if (j == len)
+					break;
+			}
+		}
+		/* the closures of the threads are only followed now that the char after them is known */
+		NfaContext context;
+		context.i = stream->pos;
+		context.atstart = !stream->pos;
+		context.atend = false;
+		context.prevword = stream->pos && iswordchar(stream->prev);
+		context.nextword = iswordchar(chunk[j]);
+		streamstep(stream, &context, &chunk[j]);
+		stream->prevprev = stream->prev;
+		stream->prev = chunk[j];
+		++stream->pos;
+	}
+	return !stream->nseeds && (stream->matchstart != NOMATCH || (pattern->anchored && stream->pos));
+}
+
+size_t re_stream_end(RegexStream* stream, size_t* length)
+{
+	NfaContext context;
+	context.i = stream->pos;
+	context.atstart = !stream->pos;
+	context.atend = true;
+	context.prevword = stream->pos && iswordchar(stream->prev);
+	context.nextword = false;
+	streamstep(stream, &context, NULL);
+
+	if (stream->matchstart == NOMATCH) {
+		errno = EINVAL;
+		return 0;
+	}
+	errno = 0;
+	if (length)
+		*length = stream->matchend - stream->matchstart;
+	return stream->matchstart;
+}
+
+static void streamstep(RegexStream* stream, const NfaContext* context, const char* c)
+{
+	const Regex* pattern = stream->pattern;
+	NfaList list;
+	list.n = 0;
+	list.slots = NULL;
+	for (size_t s = 0; s < stream->nseeds; ++s) {
+		size_t pc = stream->seedpcs[s];
+		if (stream->seedones[s]) {
+			/* now the token can see the char after the one it eats, as \R in a class needs to, and the chars before it */
+			const char window[3] = {stream->prevprev, stream->prev, c ? *c : '\0'};
+			const size_t i = context->i > 1;
+			if (matchone(pattern, NULL, pattern->nfa[pc].x, window + 1 - i, i + 1 + (c != NULL), i) == NOMATCH)
+				continue;
+			++pc;
+		}
+		nfaaddthread(pattern->nfa, &list, stream->marks, pc, stream->seedstarts[s], NULL, 0, context);
+	}
+	if (stream->matchstart == NOMATCH && (context->atstart || !pattern->anchored))
+		/* start a new match here, with the lowest priority */
+		nfaaddthread(pattern->nfa, &list, stream->marks, 0, context->i, NULL, 0, context);
+
+	stream->nseeds = 0;
+	for (size_t t = 0; t < list.n; ++t) {
+		const NfaInst* inst = &pattern->nfa[list.threads[t].pc];
+		bool eats = false;
+		bool one = false;
+		switch (inst->op) {
+			case NFA_MATCH:
+				/* the threads after this one have lower priorities, so they are dropped */
+				stream->matchstart = list.threads[t].start;
+				stream->matchend = context->i;
+				t = list.n;
+				break;
+			case NFA_SET:
+				eats = c && inset(&pattern->charsets[inst->arg], *c);
+				break;
+			case NFA_CHAR:
+				eats = c && *c == (char)inst->arg;
+				break;
+			case NFA_ONE:
+				/* whether it eats c is found out once the char after c is known, at the next step */
+				eats = one = c != NULL;
+				break;
+			default:
+				/* the other instructions are followed by nfaaddthread */
+				break;
+		}
+		if (eats) {
+			stream->seedpcs[stream->nseeds] = list.threads[t].pc + !one;
+			stream->seedones[stream->nseeds] = one;
+			stream->seedstarts[stream->nseeds] = list.threads[t].start;
+			++stream->nseeds;
+		}
+	}
+}
+
+static size_t setsearch(const RegexSet* set, const char* text, size_t len, unsigned char* matched, re_span* spans)
+{
+	/* run the DFAs of all the regexes that have one side by side, in a single pass over the text; there are at most SETBLOCK of them */
+	unsigned char states[SETBLOCK];
+	size_t live[SETBLOCK]; /* the regexes whose DFAs haven't matched or died yet */
+	size_t nlive = 0;
+	bool others = false; /* whether there are regexes without DFAs */
+	for (size_t n = 0; n < set->nregexes; ++n) {
+		if (set->regexes[n].ndfastates) {
+			states[n] = 0;
+			live[nlive++] = n;
+		} else {
+			others = true;
+		}
+	}
+
+	/* on the way, note which chars the text contains, so that the other regexes can be skipped if none of their firstchars are there */
+	CharSet present;
+	memset(present.map, 0, sizeof(present.map));
+	for (size_t i = 0; i < len && (nlive || others); ++i) {
+		const unsigned char c = text[i];
+		present.map[c / CHAR_BIT] |= 1 << (c % CHAR_BIT);
+		for (size_t l = 0; l < nlive;) {
+			const Regex* regex = &set->regexes[live[l]];
+			const unsigned char next = regex->dfa[states[live[l]] * (regex->nbyteclasses + 1) + regex->byteclass[c]];
+			if (next == DFA_MATCH || next == DFA_DEAD) {
+				if (next == DFA_MATCH)
+					matched[live[l] / CHAR_BIT] |= 1 << (live[l] % CHAR_BIT);
+				live[l] = live[--nlive];
+				continue;
+			}
+			states[live[l]] = next;
+			++l;
+		}
+	}
+	for (size_t l = 0; l < nlive; ++l) {
+		const Regex* regex = &set->regexes[live[l]];
+		if (regex->dfa[states[live[l]] * (regex->nbyteclasses + 1) + regex->nbyteclasses] == DFA_MATCH)
+			matched[live[l] / CHAR_BIT] |= 1 << (live[l] % CHAR_BIT);
+	}
+
+	size_t nmatched = 0;
+	for (size_t n = 0; n < set->nregexes; ++n) {
+		const Regex* regex = &set->regexes[n];
+		size_t start = NOMATCH;
+		size_t length = 0;
+		Budget budget = {.maxsteps = SIZE_MAX};
+		bool found;
+		if (regex->ndfastates) {
+			found = matched[n / CHAR_BIT] & (1 << (n % CHAR_BIT));
+			if (found && spans)
+				start = search(regex, text, len, 0, len, &length, NULL, 0, &budget);
+		} else if (regex->prefilter && !setsintersect(&regex->firstchars, &present)) {
+			/* none of the chars that a match has to start with are in the text */
+			found = false;
+		} else {
+			start = search(regex, text, len, 0, len, &length, NULL, 0, &budget);
+			found = start != NOMATCH;
+		}
+		if (budget.full)
+			errno = ENOBUFS;
+		if (found) {
+			matched[n / CHAR_BIT] |= 1 << (n % CHAR_BIT);
+			++nmatched;
+		}
+		if (spans) {
+			spans[n].start = start;
+			spans[n].length = length;
+		}
+	}
+	return nmatched;
+}
+
+static bool setsintersect(const CharSet* a, const CharSet* b)
+{
+	for (size_t i = 0; i < CHARSETLEN; ++i) {
+		if (a->map[i] & b->map[i])
+			return true;
+	}
+	return false;
+}
+
+static bool matchassert(unsigned char assertion, bool atstart, bool atend, bool prevword, bool nextword)
+{
+	switch (assertion) {
+		case ASSERT_START:
+			return atstart;
+		case ASSERT_END:
+			return atend;
+		case ASSERT_WORDB:
+			return prevword != nextword;
+		case ASSERT_NOTWORDB:
+			return prevword == nextword;
+		default:
+			/* should never happen */
+			return false;
+	}
+}
+
+static bool dfasearch(const Regex* pattern, const char* text, size_t len)
+{
+	const size_t rowlen = pattern->nbyteclasses + 1;
+	size_t state = 0;
+	for (size_t i = 0; i < len; ++i) {
+		const unsigned char next = pattern->dfa[state * rowlen + pattern->byteclass[(unsigned char)text[i]]];
+		if (next == DFA_MATCH)
+			return true;
+		if (next == DFA_DEAD)
+			return false;
+		state = next;
+	}
+	return pattern->dfa[state * rowlen + pattern->nbyteclasses] == DFA_MATCH;
+}
+
+static void nfacontext(NfaContext* context, const char* text, size_t len, size_t i)
+{
+	context->i = i;
+	context->atstart = i == 0;
+	context->atend = i == len;
+	context->prevword = iswordcharat(text, len, i-1);
+	context->nextword = iswordcharat(text, len, i);
+}
+
+static void nfaaddthread(const NfaInst* program, NfaList* list, size_t* marks, size_t pc, size_t start, const size_t* slots, size_t nslots, const NfaContext* context)
+{
+	/* marks[pc] is set to the position + 1 when pc is added there */
+	const size_t mark = context->i + 1;
+	/* follow the zero-width instructions depth first, so that threads are added in order of priority */
+	/* SAVE changes a slot for the instructions after it only, so it also pushes MAXNFA + the slot, which changes it back */
+	uint16_t stack[2 * MAXNFA + 1];
+	size_t stacki = 0;
+	size_t saved[MAXNFA]; /* the old values of the slots, in the order they are changed back */
+	size_t savedi = 0;
+	size_t current[MAXNFA]; /* the slots of the thread being followed; there are fewer slots than SAVE instructions */
+	if (nslots)
+		memcpy(current, slots, nslots * sizeof(current[0]));
+	stack[stacki++] = pc;
+	while (stacki) {
+		pc = stack[--stacki];
+		if (pc >= MAXNFA) {
+			current[pc - MAXNFA] = saved[--savedi];
+			continue;
+		}
+		if (marks[pc] == mark)
+			/* already added at this position by a thread with a higher priority */
+			continue;
+		marks[pc] = mark;
+
+		const NfaInst* inst = &program[pc];
+		switch (inst->op) {
+			case NFA_ASSERT:
+				if (matchassert(inst->arg, context->atstart, context->atend, context->prevword, context->nextword))
+					stack[stacki++] = pc+1;
+				break;
+			case NFA_SPLIT:
+				stack[stacki++] = inst->y;
+				stack[stacki++] = inst->x;
+				break;
+			case NFA_JMP:
+				stack[stacki++] = inst->x;
+				break;
+			case NFA_SAVE:
+				if (inst->x < nslots) {
+					saved[savedi++] = current[inst->x];
+					stack[stacki++] = MAXNFA + inst->x;
+					current[inst->x] = context->i;
+				}
+				stack[stacki++] = pc+1;
+				break;
+			default:
+				list->threads[list->n].pc = pc;
+				list->threads[list->n].start = start;
+				if (nslots)
+					memcpy(&list->slots[list->n * nslots], current, nslots * sizeof(current[0]));
+				++list->n;
+				break;
+		}
+	}
+}
+
+static size_t nfamatch(const Regex* pattern, Scratch* scratch, const char* text, size_t len, size_t from, size_t last, size_t* length, re_span* spans, size_t ngroups, Budget* budget)
+{
+	NfaList* const lists = scratch->lists;
+	NfaList* clist = &lists[0];
+	NfaList* nlist = &lists[1];
+	size_t* const marks = scratch->marks;
+	/* searchplan only runs the NFA for up to MAXNFASLOTS slots, the start and end of each group */
+	const size_t nslots = 2 * ngroups;
+	size_t slotbufs[2][MAXNFA * MAXNFASLOTS];
+	size_t unset[MAXNFASLOTS];
+	size_t slots[MAXNFASLOTS];
+	size_t matchstart = NOMATCH;
+	size_t matchend = 0;
+
+	memset(marks, 0, pattern->nnfa * sizeof(marks[0]));
+	for (size_t s = 0; s < nslots; ++s)
+		unset[s] = NOMATCH;
+	lists[0].slots = slotbufs[0];
+	lists[1].slots = slotbufs[1];
+	clist->n = 0;
+	const size_t stop = last < len ? last + 1 : len;
+	for (size_t i = from; i <= len; ++i) {
+		if (matchstart == NOMATCH && (i == 0 || !pattern->anchored) && i <= last) {
+			if (!clist->n && pattern->prefilter) {
+				/* no match is in progress, so skip to where the next one can start */
+				i = skipfirstchars(pattern, text, stop, i);
+				if (i == stop)
+					break;
+			}
+			/* start a new match here, with the lowest priority */
+			COUNT(budget, starts, 1);
+			NfaContext here;
+			nfacontext(&here, text, len, i);
+			nfaaddthread(pattern->nfa, clist, marks, 0, i, unset, nslots, &here);
+		}
+		if (!clist->n) {
+			if (matchstart != NOMATCH || pattern->anchored || i >= last)
+				break;
+			/* the new thread died without eating anything; try again at the next position */
+			continue;
+		}
+		if (spend(budget, clist->n))
+			return NOMATCH;
+
+		NfaContext next;
+		nfacontext(&next, text, len, i+1);
+		nlist->n = 0;
+		for (size_t t = 0; t < clist->n; ++t) {
+			const NfaThread* thread = &clist->threads[t];
+			const NfaInst* inst = &pattern->nfa[thread->pc];
+			bool eats = false;
+			switch (inst->op) {
+				case NFA_MATCH:
+					/* the threads after this one have lower priorities, so they are dropped */
+					matchstart = thread->start;
+					matchend = i;
+					if (nslots)
+						memcpy(slots, &clist->slots[t * nslots], nslots * sizeof(slots[0]));
+					t = clist->n;
+					break;
+				case NFA_SET:
+					eats = i < len && inset(&pattern->charsets[inst->arg], text[i]);
+					break;
+				case NFA_CHAR:
+					eats = i < len && text[i] == (char)inst->arg;
+					break;
+				case NFA_ONE:
+					COUNT(budget, matchones, 1);
+					eats = matchone(pattern, NULL, inst->x, text, len, i) != NOMATCH;
+					break;
+				default:
+					/* the other instructions are followed by nfaaddthread */
+					break;
+			}
+			if (eats)
+				nfaaddthread(pattern->nfa, nlist, marks, thread->pc+1, thread->start, &clist->slots[t * nslots], nslots, &next);
+		}
+
+		NfaList* tmp = clist;
+		clist = nlist;
+		nlist = tmp;
+	}
+
+	if (matchstart == NOMATCH)
+		return NOMATCH;
+	*length = matchend - matchstart;
+	for (size_t n = 0; n < ngroups; ++n) {
+		const bool took = slots[2*n] != NOMATCH && slots[2*n+1] != NOMATCH;
+		spans[n].start = took ? slots[2*n] : NOMATCH;
+		spans[n].length = took ? slots[2*n+1] - slots[2*n] : 0;
+	}
+	return matchstart;
+}
+
+static size_t nfamatchback(const Regex* pattern, Scratch* scratch, const char* text, size_t len, size_t from, size_t last, size_t* length, Budget* budget)
+{
+	NfaList* const lists = scratch->lists;
+	NfaList* clist = &lists[0];
+	NfaList* nlist = &lists[1];
+	size_t* const marks = scratch->marks;
+	size_t matchstart = NOMATCH;
+
+	memset(marks, 0, pattern->nrnfa * sizeof(marks[0]));
+	/* there are no slots, so the lists don't need room for them */
+	lists[0].slots = lists[1].slots = NULL;
+	NfaContext here;
+	nfacontext(&here, text, len, len);
+	clist->n = 0;
+	COUNT(budget, starts, 1);
+	nfaaddthread(pattern->rnfa, clist, marks, 0, len, NULL, 0, &here);
+	/* the program eats the text from the end towards the start; the match starting earliest is the one wanted */
+	for (size_t i = len; clist->n; --i) {
+		if (spend(budget, clist->n))
+			return NOMATCH;
+		NfaContext next;
+		if (i > from)
+			nfacontext(&next, text, len, i-1);
+		nlist->n = 0;
+		for (size_t t = 0; t < clist->n; ++t) {
+			const NfaInst* inst = &pattern->rnfa[clist->threads[t].pc];
+			bool eats = false;
+			switch (inst->op) {
+				case NFA_MATCH:
+					matchstart = i;
+					break;
+				case NFA_SET:
+					eats = i > from && inset(&pattern->charsets[inst->arg], text[i-1]);
+					break;
+				case NFA_CHAR:
+					eats = i > from && text[i-1] == (char)inst->arg;
+					break;
+				case NFA_ONE:
+					COUNT(budget, matchones, i > from);
+					eats = i > from && matchone(pattern, NULL, inst->x, text, len, i-1) != NOMATCH;
+					break;
+				default:
+					break;
+			}
+			if (eats)
+				nfaaddthread(pattern->rnfa, nlist, marks, clist->threads[t].pc+1, len, NULL, 0, &next);
+		}
+
+		NfaList* tmp = clist;
+		clist = nlist;
+		nlist = tmp;
+		if (i == from)
+			break;
+	}
+
+	if (matchstart == NOMATCH || matchstart > last)
+		return NOMATCH;
+	*length = len - matchstart;
+	return matchstart;
+}
+
+static size_t backtracksearch(const Regex* pattern, const char* text, size_t len, size_t from, size_t last, size_t* length, re_span* spans, size_t ngroups, Budget* budget)
+{
+	/* without work space from the caller, the state lives on the stack, and with RE_USE_MALLOC moves to the heap once it outgrows it */
+	size_t stackwork[WORKLEN / sizeof(size_t)];
+	Backtracker bt = {.pattern = pattern, .text = text, .len = len, .budget = budget};
+	if (!btinit(&bt, stackwork, sizeof(stackwork), ngroups != 0))
+		return NOMATCH;
+	/* the failures stay known from one start position to the next, but not from one text to the next */
+	bt.memo.lo = bt.memo.hi = from;
+	bt.noting = true;
+	if (!bt.memo.bits)
+		btcap(&bt);
+
+	size_t found = NOMATCH;
+	/* a regex starting with ^ only has to be tried at the start */
+	if (pattern->anchored)
+		last = from;
+	const size_t stop = last < len ? last + 1 : len;
+	for (size_t i = from; i <= last; ++i) {
+		if (pattern->prefilter) {
+			/* every match eats at least one of firstchars, so skip straight to the next one */
+			i = skipfirstchars(pattern, text, stop, i);
+			if (i == stop)
+				break;
+		}
+		COUNT(budget, starts, 1);
+		if (bt.spans) {
+			for (size_t pi = 0; pi < pattern->ntokens; ++pi)
+				bt.spans[pi].start = NOMATCH;
+		}
+		const size_t lengthBuf = btmatch(&bt, i);
+		/* a lookaround that gave up can look like it failed, so the result can't be trusted */
+		if (budget->exceeded)
+			break;
+		if (lengthBuf != NOMATCH) {
+			/* first successful match */
+			*length = lengthBuf;
+			/* the spans are kept per token; find the ones of the groups that were asked for */
+			for (size_t pi = 0, n = 0; pi < pattern->ntokens && n < ngroups; ++pi) {
+				if (pattern->tokens[pi].type != TOKEN_CGROUP)
+					continue;
+				spans[n].start = bt.spans[pi].start;
+				spans[n].length = bt.spans[pi].start == NOMATCH ? 0 : bt.spans[pi].length;
+				++n;
+			}
+			found = i;
+			break;
+		}
+	}
+	if (bt.capped) {
+		/* running out of those steps is running out of room for the memo */
+		if (budget->exceeded && budget->steps > budget->maxsteps && budget->maxsteps < bt.maxsteps)
+			budget->full = true;
+		budget->maxsteps = bt.maxsteps;
+	}
+#ifdef RE_USE_MALLOC
+	free(bt.heap);
+#endif
+	return found;
+}
+
+static bool btinit(Backtracker* bt, void* stack, size_t stacklen, bool spans)
+{
+	Budget* const budget = bt->budget;
+	const Regex* const pattern = bt->pattern;
+	const size_t n = pattern->ntokens;
+	void* work = budget->work ? budget->work : stack;
+	size_t worklen = budget->work ? budget->worklen : stacklen;
+	/* counts, starts and bases, then the spans and the parents */
+	const size_t registers = (n * (3 * sizeof(size_t) + (spans ? sizeof(re_span) : 0) + sizeof(uint32_t)) + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t);
+	bt->capturing = spans;
+#ifdef RE_USE_MALLOC
+	if (worklen < registers && !budget->work) {
+		worklen = registers + WORKLEN;
+		work = bt->heap = malloc(worklen);
+		if (!work)
+			worklen = 0;
+	}
+#endif
+	if (worklen < registers) {
+		budget->full = budget->exceeded = true;
+		return false;
+	}
+	btlayout(bt, work, worklen);
+
+	/* the parent of an END is its group, and the tokens after it are back in the group around that */
+	uint32_t parent = NOPARENT;
+	bt->nstates = 0;
+	for (size_t pi = 0; pi < n; ++pi) {
+		const re_Token* token = &pattern->tokens[pi];
+		if (token->type == TOKEN_END) {
+			bt->parents[pi] = (uint32_t)(pi - token->grouplen);
+		} else {
+			bt->parents[pi] = parent;
+			if (isgroup(token))
+				parent = (uint32_t)pi;
+		}
+		/* the token is in another state for each of the classes of each group around it, up to its frame; */
+		/* the END of a lookaround is left out, as what it does only depends on the frame */
+		const re_Token* const group = &pattern->tokens[bt->parents[pi]];
+		size_t states = token->type != TOKEN_END || (group->type != TOKEN_LOOKAROUND && group->type != TOKEN_INVLOOKAROUND);
+		for (size_t g = bt->parents[pi]; states && g != NOPARENT; g = bt->parents[g]) {
+			const size_t classes = btclasses(bt, g);
+			states = states > SIZE_MAX / classes ? SIZE_MAX : states * classes;
+			if (pattern->tokens[g].type == TOKEN_LOOKAROUND || pattern->tokens[g].type == TOKEN_INVLOOKAROUND || pattern->tokens[g].atomic)
+				break;
+		}
+		bt->bases[pi] = bt->nstates;
+		bt->nstates = bt->nstates > SIZE_MAX - states ? SIZE_MAX : bt->nstates + states;
+		if (token->type == TOKEN_END)
+			parent = bt->parents[bt->parents[pi]];
+	}
+
+	/* the memo has a bit per state and position, and gets half of the work space at most, so that the trail has room too */
+	bt->memo.stride = bt->nstates / CHAR_BIT + 1;
+	const size_t memolen = bt->memo.stride < SIZE_MAX / 4 / (bt->len + 1) ? (bt->memo.stride * (bt->len + 1) + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t) : SIZE_MAX;
+	bool room = registers <= worklen / 2 && memolen <= worklen / 2 - registers;
+#ifdef RE_USE_MALLOC
+	if (!room && !budget->work && memolen != SIZE_MAX) {
+		void* heap = malloc(registers + memolen + WORKLEN);
+		if (heap) {
+			memcpy(heap, work, registers);
+			free(bt->heap);
+			work = bt->heap = heap;
+			worklen = registers + memolen + WORKLEN;
+			room = true;
+		}
+	}
+#endif
+	bt->memolen = room ? memolen : 0;
+	btlayout(bt, work, worklen);
+	return true;
+}
+
+static void btlayout(Backtracker* bt, void* work, size_t worklen)
+{
+	const size_t n = bt->pattern->ntokens;
+	bt->work = work;
+	bt->worklen = worklen;
+	bt->counts = work;
+	bt->starts = bt->counts + n;
+	bt->bases = bt->starts + n;
+	bt->spans = bt->capturing ? (re_span*)(bt->bases + n) : NULL;
+	bt->parents = bt->capturing ? (uint32_t*)(bt->spans + n) : (uint32_t*)(bt->bases + n);
+	/* the registers are padded to a size_t, and so is the memo, so that the trail is aligned */
+	const size_t registers = ((size_t)((char*)(bt->parents + n) - (char*)work) + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t);
+	unsigned char* const memo = (unsigned char*)work + registers;
+	bt->memo.bits = bt->memolen ? memo : NULL;
+	bt->trail = (Trail*)(memo + bt->memolen);
+	bt->maxtrail = (worklen - (size_t)((char*)bt->trail - (char*)work)) / sizeof(Trail);
+}
+
+static bool btgrow(Backtracker* bt)
+{
+#ifdef RE_USE_MALLOC
+	/* the layout only depends on the regex, so everything is where it was after copying; work space from the caller is all it may use */
+	void* work = !bt->budget->work && bt->worklen <= SIZE_MAX / 2 ? malloc(2 * bt->worklen) : NULL;
+	if (work) {
+		memcpy(work, bt->work, bt->worklen);
+		free(bt->heap);
+		bt->heap = work;
+		btlayout(bt, work, 2 * bt->worklen);
+		return true;
+	}
+#endif
+	/* the states still to be noted can go, as long as the budget bounds how often they are tried again; */
+	/* the frames around them move down, so each is pointed at from the one after it again */
+	size_t n = 0;
+	size_t frame = NOMATCH;
+	for (size_t r = 0; r < bt->ntrail; ++r) {
+		if (bt->trail[r].kind == TRAIL_MEMO)
+			continue;
+		bt->trail[n] = bt->trail[r];
+		if (bt->trail[n].kind == TRAIL_FRAME) {
+			bt->trail[n].b = frame;
+			frame = n;
+		}
+		++n;
+	}
+	if (n < bt->ntrail) {
+		bt->ntrail = n;
+		bt->frame = frame;
+		bt->noting = false;
+		btcap(bt);
+		return true;
+	}
+	bt->budget->full = bt->budget->exceeded = true;
+	return false;
+}
+
+static void btcap(Backtracker* bt)
+{
+	Budget* const budget = bt->budget;
+	if (bt->capped)
+		return;
+	bt->capped = true;
+	bt->maxsteps = budget->maxsteps;
+	/* as many as the memo would let it take, if it was whole */
+	const size_t steps = bt->nstates < SIZE_MAX / MEMOSTEPS / (bt->len + 1) ? MEMOSTEPS * bt->nstates * (bt->len + 1) : SIZE_MAX;
+	if (steps < budget->maxsteps - budget->steps)
+		budget->maxsteps = budget->steps + steps;
+}
+
+static inline bool btpush(Backtracker* bt, uint32_t kind, size_t pi, size_t a, size_t b)
+{
+	if (bt->ntrail == bt->maxtrail && !btgrow(bt))
+		return false;
+	Trail* const record = &bt->trail[bt->ntrail++];
+	record->kind = kind;
+	record->pi = pi;
+	record->a = a;
+	record->b = b;
+	return true;
+}
+
+static bool btframe(Backtracker* bt, size_t pi, size_t i)
+{
+	/* pushing it can move the frames, so the one around it is only known afterwards */
+	if (!btpush(bt, TRAIL_FRAME, pi, i, NOMATCH))
+		return false;
+	bt->trail[bt->ntrail-1].b = bt->frame;
+	bt->frame = bt->ntrail - 1;
+	return true;
+}
+
+static bool btcount(Backtracker* bt, size_t pi, size_t i)
+{
+	/* an earlier run of the group can still be backtracked into, unless the group is at the top level */
+	if (bt->parents[pi] != NOPARENT && !btpush(bt, TRAIL_COUNT, pi, bt->counts[pi], bt->starts[pi]))
+		return false;
+	bt->counts[pi] = 0;
+	bt->starts[pi] = i;
+	return true;
+}
+
+static void btundo(Backtracker* bt, const Trail* record)
+{
+	if (record->kind == TRAIL_COUNT) {
+		bt->counts[record->pi] = record->a;
+		bt->starts[record->pi] = record->b;
+	} else if (record->kind == TRAIL_SPAN) {
+		bt->spans[record->pi].start = record->a;
+		bt->spans[record->pi].length = record->b;
+	} else if (record->kind & TRAIL_COUNTED) {
+		--bt->counts[record->pi];
+		bt->starts[record->pi] = record->b;
+	}
+}
+
+static void btcut(Backtracker* bt)
+{
+	const size_t frame = bt->frame;
+	bt->frame = bt->trail[frame].b;
+	/* the choices and the undos of the tokens in it aren't needed any more, but what it captured can still be undone from outside */
+	size_t n = frame;
+	for (size_t r = frame + 1; r < bt->ntrail; ++r) {
+		if (bt->trail[r].kind == TRAIL_SPAN)
+			bt->trail[n++] = bt->trail[r];
+	}
+	bt->ntrail = n;
+}
+
+static void btdiscard(Backtracker* bt)
+{
+	const size_t frame = bt->frame;
+	while (bt->ntrail > frame + 1)
+		btundo(bt, &bt->trail[--bt->ntrail]);
+	bt->frame = bt->trail[frame].b;
+	bt->ntrail = frame;
+}
+
+static size_t btclasses(const Backtracker* bt, size_t pi)
+{
+	const re_Token* const token = &bt->pattern->tokens[pi];
+	if (token->type == TOKEN_LOOKAROUND || token->type == TOKEN_INVLOOKAROUND) {
+		if (!(token->modifiers & MOD_B))
+			return 1;
+		const size_t maxlength = compilemaxlength(bt->pattern, pi+1);
+		return (maxlength < bt->len ? maxlength : bt->len) + 1;
+	}
+	/* see btstate */
+	const size_t max = repeatmax(bt->pattern, pi);
+	return max == SIZE_MAX ? token->quantifiermin + 2u : max ? max : 1;
+}
+
+static bool btstate(const Backtracker* bt, size_t pi, size_t i, size_t* state, bool* top)
+{
+	const Regex* const pattern = bt->pattern;
+	size_t number = bt->bases[pi];
+	size_t scale = 1;
+	*top = true;
+	for (size_t g = bt->parents[pi]; g != NOPARENT; g = bt->parents[g]) {
+		const re_Token* const group = &pattern->tokens[g];
+		if (group->type == TOKEN_LOOKAROUND || group->type == TOKEN_INVLOOKAROUND) {
+			if (group->modifiers & MOD_B) {
+				/* the tokens of a lookbehind only go forward, so once they are past its end they can't get back to it */
+				const size_t end = bt->trail[bt->frame].a;
+				if (i > end)
+					return false;
+				number += scale * (end - i);
+			}
+			*top = false;
+			break;
+		}
+		/* beyond its minimum, all that matters about the count of a group without a maximum is whether the repetition being matched has eaten anything, */
+		/* as one that doesn't ends the group */
+		size_t count = bt->counts[g];
+		if (count >= group->quantifiermin && repeatmax(pattern, g) == SIZE_MAX)
+			count = group->quantifiermin + (i == bt->starts[g]);
+		number += scale * count;
+		if (group->atomic) {
+			*top = false;
+			break;
+		}
+		scale *= btclasses(bt, g);
+	}
+	*state = number;
+	return true;
+}
+
+static size_t btlimit(const Backtracker* bt)
+{
+	for (size_t f = bt->frame; f != NOMATCH; f = bt->trail[f].b) {
+		const re_Token* const token = &bt->pattern->tokens[bt->trail[f].pi];
+		if (token->type == TOKEN_LOOKAROUND || token->type == TOKEN_INVLOOKAROUND)
+			return token->modifiers & MOD_B ? bt->trail[f].a : bt->len;
+	}
+	return bt->len;
+}
+
+static size_t btmatch(Backtracker* bt, size_t start)
+{
+	const Regex* const pattern = bt->pattern;
+	const char* const text = bt->text;
+	const size_t len = bt->len;
+	Budget* const budget = bt->budget;
+	size_t pi = 0;
+	size_t i = start;
+	Step step = STEP_TOKEN;
+	/* whether the repetition that STEP_LOOP decides on has just ended, and where the one before it started, which the record it pushes then undoes too */
+	bool counted = false;
+	size_t from = 0;
+	/* whether no choice has been taken since the last state was noted */
+	bool chained = false;
+	bt->ntrail = 0;
+	bt->frame = NOMATCH;
+
+	for (;;) {
+		const re_Token* const token = &pattern->tokens[pi];
+		switch (step) {
+			case STEP_TOKEN:
+				if (spend(budget, 1))
+					return NOMATCH;
+				if (token->type == TOKEN_END) {
+					if (token->grouplen == UINT32_MAX)
+						return i - start;
+					const size_t g = pi - token->grouplen;
+					const re_Token* const group = &pattern->tokens[g];
+					if (group->type == TOKEN_LOOKAROUND || group->type == TOKEN_INVLOOKAROUND) {
+						const Trail* const frame = &bt->trail[bt->frame];
+						if ((group->modifiers & MOD_B) && i != frame->a) {
+							/* ending in the wrong place is treated like the last token failing */
+							step = STEP_FAIL;
+							break;
+						}
+						/* whether it matches is all that counts, not how */
+						pi = g;
+						i = frame->a;
+						if (group->type == TOKEN_LOOKAROUND) {
+							btcut(bt);
+							step = STEP_NEXT;
+						} else {
+							btdiscard(bt);
+							step = STEP_FAIL;
+						}
+						break;
+					}
+				}
+
+				size_t state;
+				bool top;
+				if (!btstate(bt, pi, i, &state, &top)) {
+					step = STEP_FAIL;
+					break;
+				}
+				if (bt->memo.bits) {
+					/* a known failure is treated like the token itself failing */
+					if (memfailed(&bt->memo, state, i)) {
+						COUNT(budget, memohits, 1);
+						step = STEP_FAIL;
+						break;
+					}
+					/* outside of every frame, a state can only be tried again once its first try has failed, as a match would have ended the search; */
+					/* inside one, the first try might have matched the frame and been cut, so it is only noted once the trail gets back to it, */
+					/* unless the last state noted is still on top with no choices taken since, as this one then fails whenever that one does */
+					if (top)
+						memfail(&bt->memo, state, i);
+					else if (bt->noting && !(chained && bt->ntrail && bt->trail[bt->ntrail-1].kind == TRAIL_MEMO) && !btpush(bt, TRAIL_MEMO, pi, i, state))
+						return NOMATCH;
+					chained = true;
+				}
+
+				if (token->type == TOKEN_END) {
+					const size_t g = pi - token->grouplen;
+					const re_Token* const group = &pattern->tokens[g];
+					const size_t count = bt->counts[g] + 1;
+					if (group->type == TOKEN_CGROUP && bt->spans) {
+						if (!btpush(bt, TRAIL_SPAN, g, bt->spans[g].start, bt->spans[g].length))
+							return NOMATCH;
+						bt->spans[g].start = bt->starts[g];
+						bt->spans[g].length = i - bt->starts[g];
+					}
+					from = bt->starts[g];
+					bt->counts[g] = count;
+					bt->starts[g] = i;
+					counted = true;
+					pi = g;
+					step = STEP_LOOP;
+					if (i == from && count > group->quantifiermin && group->quantifiermax == QUANTIFIERMAX) {
+						/* the repetitions after one that ate nothing would all eat nothing too, and without a limit they would never end, so the group stops there like in PCRE */
+						if (!btpush(bt, TRAIL_COUNT, g, count - 1, from))
+							return NOMATCH;
+						step = STEP_EXIT;
+					}
+					break;
+				}
+
+				if (token->type == TOKEN_LOOKAROUND || token->type == TOKEN_INVLOOKAROUND) {
+					/* it doesn't eat anything, so repeating it changes nothing; if it is optional, it only matters if it is positive and tried first */
+					if (!token->quantifiermax || (!token->quantifiermin && (token->type == TOKEN_INVLOOKAROUND || !token->greedy))) {
+						step = STEP_NEXT;
+						break;
+					}
+					if (!btframe(bt, pi, i))
+						return NOMATCH;
+					if (token->modifiers & MOD_B) {
+						const size_t minlength = compileminlength(pattern, pi+1);
+						if (minlength > i) {
+							step = STEP_FAIL;
+							break;
+						}
+						const size_t maxlength = compilemaxlength(pattern, pi+1);
+						const size_t first = maxlength < i ? i - maxlength : 0;
+						/* the nearest start is tried first, and the record tries the ones further back */
+						if (i - minlength > first && !btpush(bt, TRAIL_BEHIND, pi, i - minlength, first))
+							return NOMATCH;
+						i -= minlength;
+					}
+					++pi;
+					break;
+				}
+				if (iszerowidth(token)) {
+					if (token->quantifiermin && matchone(pattern, budget, pi, text, len, i) == NOMATCH)
+						step = STEP_FAIL;
+					else
+						step = STEP_NEXT;
+					break;
+				}
+				const size_t body = runbody(pattern, pi);
+				if (body == NOMATCH) {
+					/* an atomic token's choices go once it has been repeated, so they are kept apart */
+					if (token->atomic && !btframe(bt, pi, i))
+						return NOMATCH;
+					if (!btcount(bt, pi, i))
+						return NOMATCH;
+					counted = false;
+					step = STEP_LOOP;
+					break;
+				}
+
+				/* the rest eat one char each time, so all of their counts are tried by one record; */
+				/* in a lookbehind, the chars after its end would all have to be given back */
+				const size_t limit = btlimit(bt);
+				if (i > limit) {
+					step = STEP_FAIL;
+					break;
+				}
+				const size_t max = repeatmax(pattern, pi);
+				const size_t most = max < limit - i ? max : limit - i;
+				const size_t least = token->quantifiermin;
+				const size_t run = runlength(pattern, budget, body, text, len, i, token->greedy || least > most ? most : least);
+				if (run < least) {
+					step = STEP_FAIL;
+					break;
+				}
+				if (token->greedy) {
+					if (!token->atomic && run > least && !btpush(bt, TRAIL_RUN, pi, i + least, i + run))
+						return NOMATCH;
+					i += run;
+				} else {
+					if (!token->atomic && most > least && !btpush(bt, TRAIL_LAZYRUN, pi, i + least, i + most))
+						return NOMATCH;
+					i += least;
+				}
+				step = STEP_NEXT;
+				break;
+
+			case STEP_LOOP: {
+				/* the group or \R at pi has been repeated counts[pi] times, up to i */
+				const size_t count = bt->counts[pi];
+				const bool more = count < repeatmax(pattern, pi);
+				if (count >= token->quantifiermin && more) {
+					if (!btpush(bt, (token->greedy ? TRAIL_EXIT : TRAIL_REPEAT) | (counted ? TRAIL_COUNTED : 0), pi, i, from))
+						return NOMATCH;
+					step = token->greedy ? STEP_REPEAT : STEP_EXIT;
+				} else {
+					if (counted && !btpush(bt, TRAIL_COUNT, pi, count - 1, from))
+						return NOMATCH;
+					step = more ? STEP_REPEAT : STEP_EXIT;
+				}
+				break;
+			}
+
+			case STEP_REPEAT:
+				if (token->type != TOKEN_METABSL) {
+					++pi;
+					step = STEP_TOKEN;
+					break;
+				}
+				/* \R eats \r\n where it can and \n otherwise, so a repetition of it has no choices of its own */
+				if (spend(budget, 1))
+					return NOMATCH;
+				const size_t n = matchone(pattern, budget, pi, text, len, i);
+				if (n == NOMATCH) {
+					step = STEP_FAIL;
+					break;
+				}
+				from = bt->starts[pi];
+				++bt->counts[pi];
+				i += n;
+				bt->starts[pi] = i;
+				counted = true;
+				step = STEP_LOOP;
+				break;
+
+			case STEP_EXIT:
+				/* an atomic token keeps the repetitions it ended with, however the rest of the regex turns out */
+				if (token->atomic)
+					btcut(bt);
+				step = STEP_NEXT;
+				break;
+
+			case STEP_NEXT:
+				pi += isgroup(token) ? token->grouplen + 1 : 1;
+				step = STEP_TOKEN;
+				break;
+
+			case STEP_FAIL:
+				if (spend(budget, 1))
+					return NOMATCH;
+				COUNT(budget, backtracks, 1);
+				if (!btback(bt, &pi, &i, &step))
+					return NOMATCH;
+				chained = false;
+				break;
+		}
+	}
+}
+
+static bool btback(Backtracker* bt, size_t* pi, size_t* i, Step* step)
+{
+	const Regex* const pattern = bt->pattern;
+	while (bt->ntrail) {
+		Trail* const record = &bt->trail[--bt->ntrail];
+		const re_Token* const token = &pattern->tokens[record->pi];
+		switch (record->kind & ~TRAIL_COUNTED) {
+			case TRAIL_COUNT: /* FALLTHROUGH */
+			case TRAIL_SPAN:
+				btundo(bt, record);
+				break;
+			case TRAIL_MEMO:
+				/* every way of matching the rest of the frame from there has failed */
+				memfail(&bt->memo, record->b, record->a);
+				break;
+			case TRAIL_FRAME:
+				bt->frame = record->b;
+				/* its token failed to match, which is what a negative or optional lookaround can go on from */
+				if (token->type == TOKEN_INVLOOKAROUND || (token->type == TOKEN_LOOKAROUND && !token->quantifiermin)) {
+					*pi = record->pi;
+					*i = record->a;
+					*step = STEP_NEXT;
+					return true;
+				}
+				break;
+			case TRAIL_RUN: {
+				/* give back one char at a time, down to one before which the token after the run can start and isn't known to fail */
+				size_t end = record->b - 1;
+				while (end > record->a && !runnext(bt, record->pi, end))
+					--end;
+				if (!runnext(bt, record->pi, end))
+					break;
+				if (end > record->a) {
+					record->b = end;
+					++bt->ntrail;
+				}
+				*pi = record->pi;
+				*i = end;
+				*step = STEP_NEXT;
+				return true;
+			}
+			case TRAIL_LAZYRUN: {
+				/* like TRAIL_RUN, but eating one more char at a time */
+				size_t end = record->a;
+				bool starts = false;
+				while (!starts && end < record->b && runone(pattern, runbody(pattern, record->pi), bt->text, bt->len, end))
+					starts = runnext(bt, record->pi, ++end);
+				if (!starts)
+					break;
+				if (end < record->b) {
+					record->a = end;
+					++bt->ntrail;
+				}
+				*pi = record->pi;
+				*i = end;
+				*step = STEP_NEXT;
+				return true;
+			}
+			case TRAIL_EXIT: /* FALLTHROUGH */
+			case TRAIL_REPEAT:
+				*pi = record->pi;
+				*i = record->a;
+				*step = (record->kind & ~TRAIL_COUNTED) == TRAIL_EXIT ? STEP_EXIT : STEP_REPEAT;
+				if (record->kind & TRAIL_COUNTED) {
+					/* the repetition it undoes stays, so it is left to undo that alone */
+					record->kind = TRAIL_COUNT;
+					record->a = bt->counts[record->pi] - 1;
+					++bt->ntrail;
+				}
+				return true;
+			case TRAIL_BEHIND:
+				/* start the lookbehind one char further back */
+				--record->a;
+				*pi = record->pi + 1;
+				*i = record->a;
+				if (record->a > record->b)
+					++bt->ntrail;
+				*step = STEP_TOKEN;
+				return true;
+		}
+	}
+	return false;
+}
+
+static size_t runbody(const Regex* pattern, size_t pi)
+{
+	const re_Token* const token = &pattern->tokens[pi];
+	if (!isloop(token))
+		return pi;
+	const re_Token* const body = token + 1;
+	if (token->type != TOKEN_GROUP || token->grouplen != 2 || isloop(body) || isgroup(body) || iszerowidth(body) || body->quantifiermin != 1 || body->quantifiermax != 1)
+		return NOMATCH;
+	return pi + 1;
+}
+
+static bool runnext(Backtracker* bt, size_t pi, size_t i)
+{
+	const Regex* const pattern = bt->pattern;
+	const size_t ni = pi + (isgroup(&pattern->tokens[pi]) ? pattern->tokens[pi].grouplen + 1 : 1);
+	const re_Token* next = &pattern->tokens[ni];
+	if (next->type == TOKEN_END) {
+		/* the END of the regex or of a lookaround has no state */
+		if (next->grouplen == UINT32_MAX || pattern->tokens[ni - next->grouplen].type == TOKEN_LOOKAROUND || pattern->tokens[ni - next->grouplen].type == TOKEN_INVLOOKAROUND)
+			return true;
+	} else if (next->charset != NOCHARSET && next->quantifiermin && (i == bt->len || !inset(&pattern->charsets[next->charset], bt->text[i]))) {
+		return false;
+	}
+	/* ending the run where the token after it is known to fail would only take a step to find that out again */
+	size_t state;
+	bool top;
+	return btstate(bt, ni, i, &state, &top) && !(bt->memo.bits && memfailed(&bt->memo, state, i));
+}
+
+static inline bool runone(const Regex* pattern, size_t pi, const char* text, size_t len, size_t i)
+{
+	if (pattern->tokens[pi].charset != NOCHARSET)
+		return inset(&pattern->charsets[pattern->tokens[pi].charset], text[i]);
+	return matchone(pattern, NULL, pi, text, len, i) != NOMATCH;
+}
+
+static size_t runlength(const Regex* pattern, Budget* budget, size_t pi, const char* text, size_t len, size_t i, size_t n)
+{
+	if (pattern->tokens[pi].charset != NOCHARSET)
+		/* the whole run can be measured at once */
+		return spanset(&pattern->charsets[pattern->tokens[pi].charset], true, text+i, n);
+	size_t run = 0;
+	while (run < n && matchone(pattern, budget, pi, text, len, i + run) != NOMATCH)
+		++run;
+	return run;
+}
+
+static bool memfailed(Memo* memo, size_t state, size_t pos)
+{
+	/* the bits of a position are cleared the first time it is looked at, which is how far most searches go */
+	if (pos >= memo->hi) {
+		memset(memo->bits + memo->hi * memo->stride, 0, (pos + 1 - memo->hi) * memo->stride);
+		memo->hi = pos + 1;
+	} else if (pos < memo->lo) {
+		/* only a lookbehind looks before where the search started */
+		memset(memo->bits + pos * memo->stride, 0, (memo->lo - pos) * memo->stride);
+		memo->lo = pos;
+	}
+	return memo->bits[pos * memo->stride + state / CHAR_BIT] & (1u << (state % CHAR_BIT));
+}
+
+static void memfail(Memo* memo, size_t state, size_t pos)
+{
+	memo->bits[pos * memo->stride + state / CHAR_BIT] |= (unsigned char)(1u << (state % CHAR_BIT));
+}
+
+static size_t literalsearch(const Regex* pattern, const char* text, size_t len, size_t from, size_t last, size_t* length, Budget* budget)
+{
+	const size_t n = pattern->nliteral;
+	*length = n;
+	if (len < n || len - n < from)
+		return NOMATCH;
+	if (pattern->anchored || pattern->literalend) {
+		/* there is only one place where the literal can be */
+		const size_t i = pattern->anchored ? 0 : len - n;
+		if ((pattern->anchored && pattern->literalend && len != n) || i > last)
+			return NOMATCH;
+		COUNT(budget, starts, 1);
+		return literalat(pattern, text, i) ? i : NOMATCH;
+	}
+	if (last > len - n)
+		last = len - n;
+	/* jump to each char that the literal can start with, then compare the rest */
+	for (size_t i = from; i <= last; ++i) {
+		i = skipfirstchars(pattern, text, last + 1, i);
+		if (i > last || spend(budget, 1))
+			break;
+		COUNT(budget, starts, 1);
+		if (literalat(pattern, text, i))
+			return i;
+	}
+	return NOMATCH;
+}
+
+static size_t findrequired(const Regex* pattern, const char* text, size_t len, size_t from)
+{
+	const size_t n = pattern->nrequired;
+	if (len < n || len - n < from)
+		return NOMATCH;
+	if (!pattern->requiredfold && n < 4) {
+		/* short strings are found faster by memchr than by skipping */
+		for (size_t i = from; i <= len - n; ++i) {
+			const char* found = memchr(text+i, pattern->required[0], len - n + 1 - i);
+			if (!found)
+				return NOMATCH;
+			i = found - text;
+			if (!memcmp(text+i, pattern->required, n))
+				return i;
+		}
+		return NOMATCH;
+	}
+	/* Horspool: compare from the last char backwards, then skip ahead by as much as the char under the last one allows */
+	const bool fold = pattern->requiredfold;
+	for (size_t i = from; i <= len - n;) {
+		const char c = fold ? foldcase(text[i+n-1]) : text[i+n-1];
+		if (c == pattern->required[n-1]) {
+			size_t k = n-1;
+			while (k && (fold ? foldcase(text[i+k-1]) : text[i+k-1]) == pattern->required[k-1])
+				--k;
+			if (!k)
+				return i;
+		}
+		i += pattern->requiredskip[(unsigned char)c];
+	}
+	return NOMATCH;
+}
+
+static bool literalat(const Regex* pattern, const char* text, size_t i)
+{
+	if (!pattern->literalfold)
+		return !memcmp(text+i, pattern->literal, pattern->nliteral);
+	for (size_t k = 0; k < pattern->nliteral; ++k) {
+		if (foldcase(text[i+k]) != pattern->literal[k])
+			return false;
+	}
+	return true;
+}
+
+static void cachelock(RegexCache* cache)
+{
+#ifdef __GNUC__
+	for (unsigned spins = 0; __atomic_test_and_set(&cache->lock, __ATOMIC_ACQUIRE); ++spins) {
+#ifdef __unix__
+		/* the thread that has it may be waiting for a CPU, e.g. while it compiles a pattern */
+		if (spins >= CACHESPINS)
+			sched_yield();
+#endif
+	}
+#else
+	/* without atomics, the cache can only be used by one thread at a time */
+	(void)cache;
+#endif
+}
+
+static void cacheunlock(RegexCache* cache)
+{
+#ifdef __GNUC__
+	__atomic_clear(&cache->lock, __ATOMIC_RELEASE);
+#else
+	(void)cache;
+#endif
+}
+
+static uint64_t cachehash(const char* pattern)
+{
+	/* FNV-1a */
+	uint64_t hash = 14695981039346656037u;
+	for (; *pattern; ++pattern) {
+		hash ^= (unsigned char)*pattern;
+		hash *= 1099511628211u;
+	}
+	return hash;
+}
+
+static size_t cacheevict(RegexCache* cache)
+{
+	/* CLOCK: the hand goes round, giving every regex that was used since it last went past another round */
+	for (size_t tries = 0; tries < 2 * cache->nentries; ++tries) {
+		const size_t e = cache->hand;
+		RegexCacheEntry* entry = &cache->entries[e];
+		cache->hand = (cache->hand + 1) % cache->nentries;
+		if (!entry->full)
+			return e;
+		if (entry->refs)
+			continue;
+		if (entry->used) {
+			entry->used = false;
+			continue;
+		}
+		/* take it out of its bucket */
+		size_t* link = &cache->entries[entry->hash % cache->nentries].head;
+		while (*link != e+1)
+			link = &cache->entries[*link-1].next;
+		*link = entry->next;
+		entry->full = false;
+		++cache->evictions;
+		return e;
+	}
+	return NOMATCH;
+}
+
+static size_t chunkstep(RegexChunk* chunk, size_t pos)
+{
+	size_t length;
+	Budget budget = {.maxsteps = SIZE_MAX};
+	/* a search from pos that finds nothing starting in the chunk finds the same as one from the next chunk */
+	const size_t start = search(chunk->pattern, chunk->text, chunk->len, pos, chunk->to - 1, &length, NULL, 0, &budget);
+	chunk->full |= budget.full;
+	if (start == NOMATCH)
+		return NOMATCH;
+	/* step over empty matches like re_find_iter */
+	return start + (length ? length : 1);
+}
+
+static inline bool spend(Budget* budget, size_t steps)
+{
+	budget->steps += steps;
+	if (budget->steps > budget->maxsteps) {
+		budget->exceeded = true;
+	} else if (budget->deadline && budget->steps >= budget->nextclock) {
+		/* clock() is too slow to call on every step */
+		budget->nextclock = budget->steps + CLOCKINTERVAL;
+		if (clock() >= budget->deadline)
+			budget->exceeded = true;
+	}
+	return budget->exceeded;
+}
+
+#ifdef RE_USE_STATS
+static inline uint64_t cycles(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	return __builtin_ia32_rdtsc();
+#elif defined(__GNUC__) && defined(__aarch64__)
+	uint64_t ticks;
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	return (uint64_t)clock();
+#endif
+}
+#endif
+
+static size_t skipfirstchars(const Regex* pattern, const char* text, size_t len, size_t i)
+{
+	if (pattern->nfirstchars == 1) {
+		const char* found = memchr(text+i, pattern->firstchar, len-i);
+		return found ? (size_t)(found-text) : len;
+	}
+	return i + spanset(&pattern->firstchars, false, text+i, len-i);
+}
+
+static inline bool inset(const CharSet* set, char c)
+{
+	const unsigned char uc = c;
+	return set->map[uc / CHAR_BIT] & (1 << (uc % CHAR_BIT));
+}
+
+static size_t spanset(const CharSet* set, bool in, const char* text, size_t n)
+{
+	size_t i = 0;
+	if (set->nranges) {
+		/* test 16 or 32 chars at once against each range; chars are biased by 0x80 first, as only signed comparisons are available */
+#if defined(RE_AVX2)
+		const __m256i bias = _mm256_set1_epi8((char)0x80);
+		for (; i + 32 <= n; i += 32) {
+			const __m256i chars = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(text+i)), bias);
+			__m256i found = _mm256_setzero_si256();
+			for (size_t r = 0; r < set->nranges; ++r) {
+				const __m256i below = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(set->first[r] ^ 0x80)), chars);
+				const __m256i above = _mm256_cmpgt_epi8(chars, _mm256_set1_epi8((char)(set->last[r] ^ 0x80)));
+				found = _mm256_or_si256(found, _mm256_andnot_si256(_mm256_or_si256(below, above), _mm256_set1_epi8(-1)));
+			}
+			const uint32_t stop = in ? ~(uint32_t)_mm256_movemask_epi8(found) : (uint32_t)_mm256_movemask_epi8(found);
+			if (stop)
+				return i + __builtin_ctz(stop);
+		}
+#elif defined(RE_SSE2)
+		const __m128i bias = _mm_set1_epi8((char)0x80);
+		for (; i + 16 <= n; i += 16) {
+			const __m128i chars = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(text+i)), bias);
+			__m128i found = _mm_setzero_si128();
+			for (size_t r = 0; r < set->nranges; ++r) {
+				const __m128i below = _mm_cmplt_epi8(chars, _mm_set1_epi8((char)(set->first[r] ^ 0x80)));
+				const __m128i above = _mm_cmpgt_epi8(chars, _mm_set1_epi8((char)(set->last[r] ^ 0x80)));
+				found = _mm_or_si128(found, _mm_andnot_si128(_mm_or_si128(below, above), _mm_set1_epi8(-1)));
+			}
+			const unsigned stop = (in ? ~_mm_movemask_epi8(found) : _mm_movemask_epi8(found)) & 0xffff;
+			if (stop)
+				return i + __builtin_ctz(stop);
+		}
+#elif defined(RE_NEON)
+		/* NEON has unsigned comparisons, so no bias is needed */
+		for (; i + 16 <= n; i += 16) {
+			const uint8x16_t chars = vld1q_u8((const uint8_t*)(text+i));
+			uint8x16_t found = vdupq_n_u8(0);
+			for (size_t r = 0; r < set->nranges; ++r)
+				found = vorrq_u8(found, vandq_u8(vcgeq_u8(chars, vdupq_n_u8(set->first[r])), vcleq_u8(chars, vdupq_n_u8(set->last[r]))));
+			if (in)
+				found = vmvnq_u8(found);
+			/* narrow each byte of the mask to 4 bits to find the first stopping char */
+			const uint64_t stop = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(found), 4)), 0);
+			if (stop)
+				return i + __builtin_ctzll(stop) / 4;
+		}
+#endif
+	}
+	for (; i < n; ++i) {
+		if (inset(set, text[i]) != in)
+			return i;
+	}
+	return n;
+}
+
+static inline size_t repeatmax(const Regex* pattern, size_t pi)
+{
+	return pattern->tokens[pi].quantifiermax == QUANTIFIERMAX ? SIZE_MAX : pattern->tokens[pi].quantifiermax;
+}
+
+static inline size_t matchone(const Regex* pattern, Budget* budget, size_t pi, const char* text, size_t len, size_t i)
+{
+	size_t ccli;
+	COUNT(budget, matchones, 1);
+	if (pattern->tokens[pi].charset != NOCHARSET) {
+		if (i >= len || !inset(&pattern->charsets[pattern->tokens[pi].charset], text[i]))
+			return NOMATCH;
+		return 1;
+	}
+	switch (pattern->tokens[pi].type) {
+		case TOKEN_METABSL:
+			return matchmeta(metabsls[pattern->tokens[pi].meta].pattern, text, len, i, pattern->tokens[pi].modifiers);
+		case TOKEN_METACHAR:
+			return matchmeta(metachars[pattern->tokens[pi].meta].pattern, text, len, i, pattern->tokens[pi].modifiers);
+		case TOKEN_CHARCLASS:
+			if (i >= len)
+				return NOMATCH;
+			for (ccli = pattern->tokens[pi].ccl; pattern->cclbuf[ccli].type != CCL_END; ++ccli) {
+				if (matchoneclc(pattern->cclbuf[ccli], text, len, i, pattern->tokens[pi].modifiers) != NOMATCH)
+					return 1;
+			}
+			/* all the chars in the class failed; matching failed */
+			return NOMATCH;
+		case TOKEN_INVCHARCLASS:
+			if (i >= len)
+				return NOMATCH;
+			for (ccli = pattern->tokens[pi].ccl; pattern->cclbuf[ccli].type != CCL_END; ++ccli) {
+				if (matchoneclc(pattern->cclbuf[ccli], text, len, i, pattern->tokens[pi].modifiers) != NOMATCH)
+					/* matchoneclc succeeded; fail the charclass */
+					return NOMATCH;
+			}
+			/* all the chars in the class failed; matching succeeded */
+			return 1;
+		case TOKEN_CHAR:
+			if (
+				i >= len ||
+				( (pattern->tokens[pi].modifiers & MOD_I) && pattern->tokens[pi].ch != foldcase(text[i])) ||
+				(!(pattern->tokens[pi].modifiers & MOD_I) &&         pattern->tokens[pi].ch  !=         text[i] )
+			)
+				return NOMATCH;
+			return 1;
+		default:
+			/* unknown re_Token type: should never happen */
+			return NOMATCH;
+	}
+	/* UNREACHABLE */
+}
+
+static size_t matchoneclc(ClassChar pattern, const char* text, size_t len, size_t i, Modifiers modifiers)
+{
+	/* this function always returns 1 or NOMATCH */
+	switch (pattern.type) {
+		case CCL_METABSL:
+			if (matchmeta(metabsls[pattern.meta].pattern, text, len, i, modifiers) == NOMATCH)
+				return NOMATCH;
+			return 1;
+		case CCL_CHARRANGE:
+			if (
+				( (modifiers & MOD_I) && (foldcase(text[i]) < pattern.first || foldcase(text[i]) > pattern.last)) ||
+				(!(modifiers & MOD_I) && (        text[i]  <         pattern.first  ||         text[i]  >         pattern.last ))
+			)
+				return NOMATCH;
+			return 1;
+		default:
+			/* should never happen */
+			return NOMATCH;
+	}
+	/* UNREACHABLE */
+}
+
+static inline size_t matchmeta(char meta, const char* text, size_t len, size_t i, Modifiers modifiers)
+{
+	switch (meta) {
+		case 's':
+			return i < len && chartype(text[i], CT_SPACE) ? 1 : NOMATCH;
+		case 'S':
+			return i < len && !chartype(text[i], CT_SPACE) ? 1 : NOMATCH;
+		case 'd':
+			return i < len && chartype(text[i], CT_DIGIT) ? 1 : NOMATCH;
+		case 'D':
+			return i < len && !chartype(text[i], CT_DIGIT) ? 1 : NOMATCH;
+		case 'w':
+			return i < len && iswordchar(text[i]) ? 1 : NOMATCH;
+		case 'W':
+			return i < len && !iswordchar(text[i]) ? 1 : NOMATCH;
+		case 'R':
+			if (i+1 < len && text[i] == '\r' && text[i+1] == '\n')
+				return 2;
+			return i < len && text[i] == '\n' ? 1 : NOMATCH;
+		case 'b':
+			return iswordcharat(text, len, i-1) != iswordcharat(text, len, i) ? 0 : NOMATCH;
+		case 'B':
+			return iswordcharat(text, len, i-1) == iswordcharat(text, len, i) ? 0 : NOMATCH;
+		case '^':
+			return i == 0 ? 0 : NOMATCH;
+		case '$':
+			return i == len ? 0 : NOMATCH;
+		case '.':
+			return i < len && ((modifiers & MOD_S) || text[i] != '\n') ? 1 : NOMATCH;
+		default:
+			/* unknown metabsl or metachar: should never happen */
+			return NOMATCH;
+	}
+	/* UNREACHABLE */
+}
+
+/*
+ * PRINTING FUNCTIONS
+ */
+
+void re_print(Regex pattern)
+{
+	for (size_t i = 0; !(pattern.tokens[i].type == TOKEN_END && pattern.tokens[i].grouplen == UINT32_MAX); ++i)
+		printone(pattern.tokens[i], pattern.cclbuf);
+}
+
+#ifdef RE_USE_STATS
+void re_stats_print(const Regex* pattern, const re_stats* stats)
 {
-	for (size_t i = 0; !(pattern.tokens[i].type == TOKEN_END && pattern.tokens[i].grouplen == SIZE_MAX); ++i)
-		printone(pattern.tokens[i]);
+	re_print(*pattern);
+	printf("\n");
+	printf("  searches: %zu, of which %zu matched\n", stats->searches, stats->matches);
+	printf("  turned down: %zu too short, %zu without the required string, %zu by the DFA\n", stats->tooshort, stats->norequired, stats->dfarejects);
+	printf("  engines: %zu literal, %zu backward NFA, %zu NFA, %zu backtracker\n", stats->literal, stats->backward, stats->nfa, stats->backtracker);
+	printf("  work: %zu starts, %zu matchone calls, %zu steps, %zu backtracks, %zu memo hits\n", stats->starts, stats->matchones, stats->steps, stats->backtracks, stats->memohits);
+	if (stats->timed)
+		printf("  cycles: %"PRIu64" (%.1f per search)\n", stats->cycles, stats->searches ? (double)stats->cycles / stats->searches : 0.0);
 }
+#endif
 
-static void printone(re_Token pattern)
+static void printone(re_Token pattern, const ClassChar* cclbuf)
 {
 	switch (pattern.type) {
 		case TOKEN_END:
@@ -888,10 +4208,10 @@ static void printone(re_Token pattern)
 			printf("(");
 			return;
 		case TOKEN_LOOKAROUND:
-			printf("(?=");
+			printf(pattern.modifiers & MOD_B ? "(?<=" : "(?=");
 			return;
 		case TOKEN_INVLOOKAROUND:
-			printf("(?!");
+			printf(pattern.modifiers & MOD_B ? "(?<!" : "(?!");
 			return;
 		case TOKEN_METABSL:
 			printf("\\%c", metabsls[pattern.meta].pattern);
@@ -904,8 +4224,8 @@ static void printone(re_Token pattern)
 			printf("[");
 			if (pattern.type == TOKEN_INVCHARCLASS)
 				printf("^");
-			for (size_t i = 0; pattern.ccl[i].type != CCL_END; ++i)
-				printoneclc(pattern.ccl[i]);
+			for (size_t i = pattern.ccl; cclbuf[i].type != CCL_END; ++i)
+				printoneclc(cclbuf[i]);
 			printf("]");
 			break;
 		case TOKEN_CHAR:
@@ -925,11 +4245,11 @@ static void printone(re_Token pattern)
 	if (pattern.quantifiermin != 1 || pattern.quantifiermax != 1) {
 		printf("{");
 		if (pattern.quantifiermin != 0)
-			printf("%"PRIuFAST8, pattern.quantifiermin);
+			printf("%"PRIu16, pattern.quantifiermin);
 		if (pattern.quantifiermax == QUANTIFIERMAX)
 			printf(",");
 		else if (pattern.quantifiermax != pattern.quantifiermin)
-			printf(",%"PRIuFAST8, pattern.quantifiermax);
+			printf(",%"PRIu16, pattern.quantifiermax);
 		printf("}");
 	}
 nocharquantifier:
@@ -12,17 +12,50 @@ extern "C" {
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
-/* max number of tokens in regex */
+/* max number of tokens in regex, when it is stored in the Regex itself (see re_compilebuf) */
 #define MAXTOKENS 30
-/* max length of character-class buffer */
+/* max length of character-class buffer, when it is stored in the Regex itself */
 #define CCLBUFLEN 20
-/* max number of nested groups */
-#define MAXGROUPS 5
+/* max number of different charsets (sets of chars eaten by single-char tokens) */
+#define MAXCHARSETS 8
+/* number of bytes in a bitmap of every char */
+#define CHARSETLEN 32
+/* max number of ranges a charset can be split into to be scanned with SIMD */
+#define MAXCHARSETRANGES 4
+/* charset index of tokens that don't have one; has to fit in the charset bits of re_Token */
+#define NOCHARSET 63
+/* max number of instructions in the NFA program */
+#define MAXNFA 128
+/* max number of capture slots (two per group) that the NFA fills; a search that asks for more groups runs the backtracker */
+#define MAXNFASLOTS 16
+/* max number of tokens, and of class chars, of a regex that is compiled into automata; few larger regexes would fit in MAXNFA instructions */
+#define MAXNFATOKENS (4 * MAXNFA)
+#define MAXNFACCL (8 * MAXNFA)
+/* max number of states in the DFA */
+#define MAXDFASTATES 64
+/* max number of transitions in the DFA table (states * (byte classes + 1)) */
+#define MAXDFATRANS 1024
+/* max number of bytes of automata (the NFA programs and the DFA), when they are stored in the Regex itself; a regex that needs more is matched without some of them */
+#define AUTOMATALEN 512
+/* max number of bytes of automata that any regex has */
+#define MAXAUTOMATALEN (2 * MAXNFA * sizeof(NfaInst) + CHARSETLEN * 8 + MAXDFATRANS)
+/* max length of a regex that is searched for as a plain string */
+#define MAXLITERAL 32
+/* max number of search positions that a RegexChunk remembers, to get back in step with the chunk before it */
+#define MAXSYNC 8
+/* max length of a pattern that a RegexCache keeps, including the terminating NUL */
+#define MAXCACHEPATTERN 64
+/* max number of threads that re_matchg_parallel matches chunks in */
+#define MAXTHREADS 64
+/* number of bytes of stack that the backtracker keeps its choices in, unless it is given work space by re_match_opts */
+#define WORKLEN 16384
 
 typedef uint_fast8_t Modifiers;
-typedef uint_fast8_t Quantifier;
-#define QUANTIFIERMAX UINT_FAST8_MAX
+typedef uint16_t Quantifier;
+/* a {} count of QUANTIFIERMAX stands for no limit, so {m,n} can count up to QUANTIFIERMAX-1 */
+#define QUANTIFIERMAX UINT16_MAX
 
 /* enum for all the types a char in a char class can be */
 typedef enum ClassCharType
@@ -35,10 +68,10 @@ typedef enum ClassCharType
 /* a char that can go inside a CHARCLASS (represented by [])*/
 typedef struct ClassChar
 {
-	ClassCharType type;
+	unsigned char type; /* ClassCharType */
 	union
 	{
-		size_t meta; /* METABSL/INVMETABSL: index in metabsls */
+		unsigned char meta; /* METABSL/INVMETABSL: index in metabsls */
 		struct /* CHARRANGE */
 		{
 			char first; /* first char in range */
@@ -47,6 +80,15 @@ typedef struct ClassChar
 	};
 } ClassChar;
 
+/* a set of chars, with the same contents stored as a bitmap and (if it is small enough) as a list of ranges */
+typedef struct CharSet
+{
+	unsigned char map[CHARSETLEN]; /* bitmap of all the chars in the set, indexed by unsigned char */
+	unsigned char nranges; /* number of ranges, or 0 if there are more than MAXCHARSETRANGES */
+	unsigned char first[MAXCHARSETRANGES]; /* first char of each range */
+	unsigned char last[MAXCHARSETRANGES]; /* last char of each range */
+} CharSet;
+
 /* the different types that each regex token can be */
 typedef enum TokenType
 {
@@ -62,46 +104,339 @@ typedef enum TokenType
 	TOKEN_CHAR /* a literal character */
 } TokenType;
 
-/* struct for each regex token */
+/* struct for each regex token, packed into 12 bytes so that a whole regex fits in a few cache lines */
 typedef struct re_Token re_Token;
 struct re_Token
 {
-	TokenType type;
+	/* the type, flags and quantifier, in 48 bits */
+	unsigned type : 4; /* TokenType */
+	unsigned modifiers : 4; /* Modifiers */
+	unsigned greedy : 1; /* whether the token is greedy (takes up as many characters as possible) or lazy (takes up as few characters as possible) */
+	unsigned atomic : 1; /* whether the token is atomic (cannot change if the rest of the regex fails) or not; sometimes known as possessive */
+	unsigned charset : 6; /* tokens that always eat exactly one char: index in charsets, or NOCHARSET */
+	unsigned quantifiermin : 16;
+	unsigned quantifiermax : 16;
+	/* the operand */
 	union
 	{
-		size_t grouplen; /* END/GROUP/CGROUP/LOOKAROUND/INVLOOKAROUND: length of the group */
-		size_t meta; /* METABSL/INVMETABSL/METACHAR: index in metabsls/metachars */
-		ClassChar* ccl; /* CHARCLASS/INVCHARCLASS: a pointer to characters in class (pointer to somewhere in cclbuf) */
+		uint32_t grouplen; /* END/GROUP/CGROUP/LOOKAROUND/INVLOOKAROUND: length of the group */
+		uint32_t meta; /* METABSL/INVMETABSL/METACHAR: index in metabsls/metachars */
+		uint32_t ccl; /* CHARCLASS/INVCHARCLASS: index of the characters in class in cclbuf */
 		char ch; /* CHAR: the character itself */
 	};
-	Modifiers modifiers;
-	Quantifier quantifiermin;
-	Quantifier quantifiermax;
-	bool greedy; /* whether the token is greedy (takes up as many characters as possible) or lazy (takes up as few characters as possible) */
-	bool atomic; /* whether the token is atomic (cannot change if the rest of the regex fails) or not; sometimes known as possessive */
 };
 
+/* the operations of NFA instructions */
+typedef enum NfaOp
+{
+	NFA_MATCH, /* the whole regex has matched */
+	NFA_SET, /* eats one char in a charset */
+	NFA_CHAR, /* eats one literal char */
+	NFA_ONE, /* eats one char matched by a token that has no charset */
+	NFA_ASSERT, /* zero-width assertion, such as ^ or \b */
+	NFA_SPLIT, /* continues at both x and y, preferring x */
+	NFA_JMP, /* continues at x */
+	NFA_SAVE /* stores the position in capture slot x, then continues */
+} NfaOp;
+
+/* the zero-width assertions of NFA_ASSERT */
+typedef enum NfaAssert
+{
+	ASSERT_START, /* ^ */
+	ASSERT_END, /* $ */
+	ASSERT_WORDB, /* \b */
+	ASSERT_NOTWORDB /* \B */
+} NfaAssert;
+
+/* an instruction in the NFA program that the regex is compiled to, when the regex doesn't need backtracking */
+typedef struct NfaInst
+{
+	unsigned char op; /* NfaOp */
+	unsigned char arg; /* SET: index in charsets, CHAR: the char, ASSERT: NfaAssert */
+	uint16_t x; /* SPLIT/JMP: index of the next instruction (the preferred one for SPLIT), ONE: index of the token, SAVE: capture slot */
+	uint16_t y; /* SPLIT: index of the other next instruction */
+} NfaInst;
+
+/* the part of the text that a match or capturing group covers */
+typedef struct re_span
+{
+	size_t start; /* index of the first char, or SIZE_MAX if the group didn't take part in the match */
+	size_t length; /* number of chars */
+} re_span;
+
+/* the result of matching one of the texts given to re_match_batch: the span of the match, with a start of SIZE_MAX if there is none */
+typedef re_span re_result;
+
+#ifdef RE_USE_STATS
+/* counters of the work done by searches, to find out why a regex takes long; see re_stats_attach */
+typedef struct re_stats
+{
+	size_t searches; /* number of searches for a match, made by any of the matching functions except the stream ones */
+	size_t matches; /* number of searches that found one */
+	size_t tooshort; /* searches turned down because the text is shorter than the fewest chars a match can eat */
+	size_t norequired; /* searches turned down because the text doesn't have the string that every match contains where a match could be */
+	size_t dfarejects; /* searches turned down by the DFA before the NFA ran */
+	size_t literal; /* searches that compared a plain string */
+	size_t backward; /* searches that ran the NFA backwards from the end of the text */
+	size_t nfa; /* searches that ran the NFA */
+	size_t backtracker; /* searches that ran the backtracker */
+	size_t starts; /* positions at which a match was tried */
+	size_t matchones; /* tokens matched once at a position (calls to matchone) */
+	size_t steps; /* the steps that re_match_opts.maxsteps limits */
+	size_t backtracks; /* times the backtracker went back to an earlier token */
+	size_t memohits; /* (token, position) states that the backtracker didn't try, as they were known to fail */
+	bool timed; /* set by the caller: whether to count cycles too */
+	uint64_t cycles; /* time taken by the searches, in ticks of the CPU's time stamp counter (or of clock() without one) */
+} re_stats;
+#endif
+
 /* main struct for a regex */
 typedef struct Regex
 {
-	re_Token tokens[MAXTOKENS]; /* array of tokens in regex */
-	ClassChar cclbuf[CCLBUFLEN]; /* buffer in which character class strings are stored */
+	re_Token* tokens; /* array of tokens in regex: inlinetokens, or the buffer given to re_compilebuf */
+	ClassChar* cclbuf; /* buffer in which character class strings are stored: inlinecclbuf, or the end of the buffer given to re_compilebuf */
+#ifdef RE_USE_STATS
+	re_stats* stats; /* where the searches with this regex are counted, or NULL */
+#endif
 	size_t ccli; /* index into buffer */
+	size_t ntokens; /* number of tokens in regex, not including the terminating END */
+	size_t ncaptures; /* number of capturing groups */
+	CharSet charsets[MAXCHARSETS]; /* the sets of chars eaten by single-char tokens */
+	size_t ncharsets; /* number of charsets */
+	CharSet firstchars; /* the chars that a match can start with */
+	size_t nfirstchars; /* number of chars in firstchars */
+	char firstchar; /* if there is only one char in firstchars, that char */
+	bool prefilter; /* whether every match starts with one of firstchars, so other start positions can be skipped */
+	bool anchored; /* whether every match has to start at the start of the text (the regex starts with ^) */
+	char literal[MAXLITERAL]; /* if the regex is nothing but literal chars, maybe between ^ and $, those chars (lowercase if literalfold) */
+	size_t nliteral; /* number of chars in literal, or 0 if the regex isn't a literal */
+	bool literalfold; /* whether literal is matched ignoring case */
+	bool literalend; /* whether literal has to end at the end of the text (the regex ends with $) */
+	size_t maxlength; /* most chars that a match can eat, or SIZE_MAX if there is no limit */
+	size_t minlength; /* fewest chars that a match can eat; texts shorter than that are rejected straight away */
+	char required[MAXLITERAL]; /* the longest string that is in every match (lowercase if requiredfold), for regexes that aren't a literal */
+	size_t nrequired; /* number of chars in required, or 0 if there is none */
+	bool requiredfold; /* whether required is found ignoring case */
+	size_t requiredoffset; /* most chars that a match can eat before required, or SIZE_MAX if there is no limit */
+	unsigned char requiredskip[CHARSETLEN * 8]; /* how far the search for required moves on when each char is under its last one */
+	NfaInst* nfa; /* NFA program, run in linear time instead of backtracking: in inlineautomata, or after the class chars in the buffer given to re_compilebuf */
+	size_t nnfa; /* number of instructions in nfa, or 0 if the regex needs the backtracker (lookarounds or atomic quantifiers) or doesn't fit */
+	NfaInst* rnfa; /* the NFA program with the tokens the other way round, run backwards from the end of the text when every match has to end there; right after nfa */
+	size_t nrnfa; /* number of instructions in rnfa, or 0 if there is no such program */
+	unsigned char* byteclass; /* DFA: the class of each of the CHARSETLEN * 8 chars, right after rnfa; chars in the same class are never told apart by the regex */
+	size_t nbyteclasses; /* DFA: number of byte classes */
+	unsigned char* dfa; /* DFA: transition table right after byteclass, with a row of nbyteclasses+1 entries per state; the last entry is used at the end of the text */
+	size_t ndfastates; /* number of states in the DFA, or 0 if there is no DFA */
+	re_Token inlinetokens[MAXTOKENS]; /* tokens of small regexes, kept last so that they are next to what is used while matching */
+	NfaInst inlineautomata[AUTOMATALEN / sizeof(NfaInst)]; /* automata of small regexes */
+	ClassChar inlinecclbuf[CCLBUFLEN]; /* character class strings of small regexes */
 } Regex;
 
+/* a set of regexes that are matched against the same text together */
+typedef struct RegexSet
+{
+	Regex* regexes; /* the compiled regexes, in the array given to re_set_compile */
+	size_t nregexes; /* number of regexes */
+} RegexSet;
+
+/* a regex kept by a RegexCache, in the storage given to re_cache_init */
+typedef struct RegexCacheEntry
+{
+	Regex regex; /* the compiled pattern, kept first so that re_cache_release can find its entry */
+	char pattern[MAXCACHEPATTERN]; /* the pattern it was compiled from */
+	uint64_t hash; /* hash of pattern */
+	bool full; /* whether the entry holds a regex */
+	bool used; /* whether it was asked for since the clock hand last went past it */
+	size_t refs; /* number of re_cache_get calls for it that haven't been released */
+	size_t head; /* 1 + index of the first entry whose hash picks this entry's index as bucket, or 0 */
+	size_t next; /* 1 + index of the next entry in the same bucket, or 0 */
+} RegexCacheEntry;
+
+/* a fixed number of compiled regexes, looked up by their pattern so that each pattern is only compiled once */
+typedef struct RegexCache
+{
+	RegexCacheEntry* entries; /* the storage given to re_cache_init */
+	size_t nentries; /* number of entries */
+	size_t hand; /* the clock hand: index of the entry that is looked at first to be evicted */
+	size_t hits; /* number of re_cache_get calls that found the pattern compiled already */
+	size_t misses; /* number of re_cache_get calls that compiled it */
+	size_t evictions; /* number of regexes that were thrown out to make room for another */
+	unsigned char lock; /* taken while a thread uses the cache */
+} RegexCache;
+
+/* what re_info finds out about a compiled regex */
+typedef struct RegexInfo
+{
+	size_t minlength; /* fewest chars that a match can eat */
+	size_t maxlength; /* most chars that a match can eat, or SIZE_MAX if there is no limit */
+	size_t ncaptures; /* number of capturing groups */
+	bool anchored; /* whether every match has to start at the start of the text */
+	bool linear; /* whether matching takes time linear in the length of the text; if not, the backtracker is used, and only re_matchopts bounds its work */
+	size_t nrequired; /* length of the longest string that every match contains, or 0 if there is none */
+} RegexInfo;
+
+/* limits on how much work re_matchopts may do */
+typedef struct re_match_opts
+{
+	size_t maxsteps; /* most steps that matching may take, or 0 for no limit; a step is one token tried by the backtracker or one NFA thread moved over one char */
+	clock_t deadline; /* value of clock() at which matching gives up, or 0 for no deadline */
+	size_t steps; /* set to the number of steps taken, also when matching gave up */
+	void* work; /* if not NULL, where the backtracker keeps its choices instead of WORKLEN bytes of stack (aligned like malloc's memory) */
+	size_t worklen; /* number of bytes of work */
+#ifdef RE_USE_STATS
+	re_stats* stats; /* if not NULL, where this call is counted instead of in the stats of the regex */
+#endif
+} re_match_opts;
+
+/* a cursor over the matches of a regex in a text */
+typedef struct RegexIter
+{
+	const Regex* pattern;
+	const char* text;
+	size_t len;
+	size_t pos; /* index where the search for the next match starts, or len+1 if there are no more */
+} RegexIter;
+
+/* a chunk of a text whose matches are counted apart from the rest, for example in another thread */
+typedef struct RegexChunk
+{
+	const Regex* pattern;
+	const char* text; /* the whole text */
+	size_t len; /* length of the whole text */
+	size_t from; /* first position in the chunk where a search for a match can start */
+	size_t to; /* position after the last one in the chunk; the last chunk ends at len+1, as a match can start at len */
+	size_t count; /* number of matches found by searching from positions in the chunk */
+	size_t end; /* position after the chunk where the search for the next match starts */
+	size_t start; /* set by re_chunk_join: the first position in the chunk that re_find_iter searches from, or to if there is none */
+	size_t nsync; /* number of positions in sync */
+	size_t sync[MAXSYNC]; /* the first positions that the search for a match started from */
+	bool full; /* whether the backtracker ran out of room for a search in the chunk */
+} RegexChunk;
+
+/* the state of matching a regex against a text that is fed in pieces */
+typedef struct RegexStream
+{
+	const Regex* pattern; /* the regex, which has to stay alive while the stream is used */
+	size_t pos; /* number of chars fed so far */
+	char prev; /* the last char fed, if pos isn't 0 */
+	char prevprev; /* the char fed before prev, if pos is more than 1 */
+	size_t matchstart; /* start of the best match found so far, or SIZE_MAX */
+	size_t matchend; /* end of the best match found so far */
+	size_t nseeds; /* number of NFA threads waiting for the next char */
+	uint16_t seedpcs[MAXNFA]; /* the instructions that they continue at, in order of priority */
+	bool seedones[MAXNFA]; /* whether each is an NFA_ONE that has yet to find out if it eats prev, which its token may only know from the char after */
+	size_t seedstarts[MAXNFA]; /* where their matches started */
+	size_t marks[MAXNFA]; /* position + 1 where each instruction was last added */
+} RegexStream;
+
 /* re_compile: compile regex string pattern to a Regex) */
 void re_compile(Regex* compiled, const char* pattern);
+/* re_compilesize: returns the number of bytes of buffer that re_compilebuf needs for pattern with all of its automata, or 0 if pattern is invalid */
+size_t re_compilesize(const char* pattern);
+/* re_compilebuf: same as re_compile, but stores the tokens and automata in buf (aligned like malloc's memory) so that MAXTOKENS, CCLBUFLEN and AUTOMATALEN don't apply */
+/* buf only needs room for the tokens and class chars; the automata that don't fit in the rest of it are left out, as in re_compile */
+/* buf must stay alive and unchanged as long as the Regex is used */
+void re_compilebuf(Regex* compiled, const char* pattern, void* buf, size_t size);
+#ifdef RE_USE_MALLOC
+/* re_compilealloc: same as re_compilebuf, but allocates the buffer with malloc if the regex doesn't fit in the Regex itself */
+void re_compilealloc(Regex* compiled, const char* pattern);
+/* re_free: frees the buffer allocated by re_compilealloc */
+void re_free(Regex* compiled);
+#endif
+
+/* re_cache_init: makes cache keep up to nentries compiled regexes in entries, which must stay alive as long as cache is used */
+void re_cache_init(RegexCache* cache, RegexCacheEntry* entries, size_t nentries);
+/* re_cache_get: returns pattern compiled, compiling it only if it isn't in cache; identical patterns share one Regex, which stays valid until re_cache_release */
+/* returns NULL with errno set if pattern doesn't compile, is too long for MAXCACHEPATTERN or the Regex itself, or every entry is in use; can be called from several threads at once */
+const Regex* re_cache_get(RegexCache* cache, const char* pattern);
+/* re_cache_release: gives back a regex returned by re_cache_get, so that it can be evicted once nothing else uses it; sets errno to EINVAL if it isn't held from cache */
+void re_cache_release(RegexCache* cache, const Regex* compiled);
+
+/* re_serialize: stores compiled in buf so that re_deserialize can load it, also in another process, returns the number of bytes that are needed */
+/* if size is less than that, sets errno to ENOBUFS and stores nothing; the number is a multiple of 8, so regexes can be stored one after another */
+size_t re_serialize(const Regex* compiled, void* buf, size_t size);
+/* re_deserialize: loads a regex stored by re_serialize from data (aligned like malloc's memory), returns the number of bytes it took up */
+/* sets errno to EINVAL if data wasn't stored by a build with the same version and limits, or was damaged so that matching could go outside of it; regexes too large for the Regex itself keep using data, which must then stay alive and unchanged (and mustn't be freed with re_free) */
+size_t re_deserialize(Regex* compiled, const void* data, size_t size);
+
+/* re_info: stores what is known about pattern from compiling it in info, such as how long its matches can be, e.g. to turn down regexes that could take too long */
+void re_info(const Regex* pattern, RegexInfo* info);
 
 /* re_match: returns index of first match of pattern in text */
 /* stores the length of the match in length if it is not NULL */
 size_t re_match(Regex pattern, const char* text, size_t* length);
+/* re_matchp: same as re_match, but doesn't copy the Regex */
+size_t re_matchp(const Regex* pattern, const char* text, size_t* length);
+/* re_matchn: same as re_matchp, but text is len chars long and doesn't need to be null-terminated */
+/* sets errno to ENOBUFS if the backtracker runs out of room (WORKLEN bytes, unless it is given more) for its choices, or for the failures it remembers and then takes too many steps without them, before it finds a match */
+size_t re_matchn(const Regex* pattern, const char* text, size_t len, size_t* length);
+
+/* re_match_batch: matches pattern against each of the n texts, which are lens[i] chars long (or null-terminated if lens is NULL), and stores the results in out */
+/* returns the number of texts that matched; the engine and its buffers are set up once for all of them, and the regex isn't copied as re_match does, which pays off when the texts are short */
+/* sets errno to ENOBUFS if the backtracker ran out of room for any of them, and to 0 otherwise */
+size_t re_match_batch(const Regex* pattern, const char* const* texts, const size_t* lens, size_t n, re_result* out);
+
+/* re_match_captures: same as re_matchn, but stores the span of the match in caps[0] and the span of the nth capturing group in caps[n], for n < ncaps */
+size_t re_match_captures(const Regex* pattern, const char* text, size_t len, re_span* caps, size_t ncaps);
+
+/* re_matchopts: same as re_matchn, but gives up with errno set to ETIMEDOUT once opts->maxsteps or opts->deadline is reached */
+/* the backtracker keeps its choices and the failures it remembers in opts->work if it isn't NULL, and sets errno to ENOBUFS if they don't fit there */
+size_t re_matchopts(const Regex* pattern, const char* text, size_t len, size_t* length, re_match_opts* opts);
+
+/* re_find_init: starts iterating over the matches of pattern in text, which is len chars long */
+void re_find_init(RegexIter* iter, const Regex* pattern, const char* text, size_t len);
+/* re_find_iter: finds the next match, returns whether there is one; if ncaps isn't 0, its span goes in caps[0] and those of its capturing groups in the rest like re_match_captures */
+/* anchors and \b see the whole text, not just the part after the previous match; sets errno to ENOBUFS if the backtracker ran out of room, and to 0 otherwise */
+bool re_find_iter(RegexIter* iter, re_span* caps, size_t ncaps);
 
 /* re_matchg: returns number of matches of pattern in text */
 size_t re_matchg(Regex pattern, const char* text);
+/* re_matchgp: same as re_matchg, but doesn't copy the Regex */
+size_t re_matchgp(const Regex* pattern, const char* text);
+/* re_matchgn: same as re_matchgp, but text is len chars long and doesn't need to be null-terminated */
+size_t re_matchgn(const Regex* pattern, const char* text, size_t len);
+
+/* re_chunk_split: splits text into at most nchunks chunks of about the same size for pattern, returns how many there are */
+size_t re_chunk_split(RegexChunk* chunks, size_t nchunks, const Regex* pattern, const char* text, size_t len);
+/* re_chunk_match: counts the matches in chunk as if the search for one started at its start; chunks can be matched at the same time */
+void re_chunk_match(RegexChunk* chunk);
+/* re_chunk_join: puts together the counts of chunks matched by re_chunk_match, returns the number of matches like re_matchgn */
+/* matches that go over the end of a chunk are taken into account by searching the start of the next over again, until it is back in step */
+/* sets errno to ENOBUFS if the backtracker ran out of room in any chunk, and to 0 otherwise */
+size_t re_chunk_join(RegexChunk* chunks, size_t nchunks);
+#ifdef RE_USE_PTHREADS
+/* re_matchg_parallel: same as re_matchgn, but matches nthreads chunks of text in as many threads, up to MAXTHREADS */
+size_t re_matchg_parallel(const Regex* pattern, const char* text, size_t len, size_t nthreads);
+#endif
+
+/* re_set_compile: compiles npatterns patterns into the array regexes, and makes set refer to them */
+/* if a pattern fails to compile, errno is set and nregexes is the index of that pattern */
+void re_set_compile(RegexSet* set, Regex* regexes, const char* const* patterns, size_t npatterns);
+/* re_set_match: sets bit n%8 of matched[n/8] if regex n of set matches text and clears it otherwise, returns number of regexes that matched */
+size_t re_set_match(const RegexSet* set, const char* text, size_t len, unsigned char* matched);
+/* re_set_find: same as re_set_match, but stores where each regex first matches in spans (with a start of SIZE_MAX if it doesn't) */
+/* both set errno to ENOBUFS if the backtracker ran out of room for any regex, and to 0 otherwise */
+size_t re_set_find(const RegexSet* set, const char* text, size_t len, re_span* spans);
+
+/* re_stream_init: starts matching pattern against a text that is fed in pieces; sets errno to ENOTSUP if pattern needs the backtracker */
+void re_stream_init(RegexStream* stream, const Regex* pattern);
+/* re_stream_feed: feeds the next len chars of the text, returns whether the result is already known so the rest doesn't have to be fed */
+bool re_stream_feed(RegexStream* stream, const char* chunk, size_t len);
+/* re_stream_end: ends the text, returns the index in the whole text of the first match like re_matchn */
+/* stores the length of the match in length if it is not NULL */
+size_t re_stream_end(RegexStream* stream, size_t* length);
 
 /* re_print: prints a regex to stdout */
 void re_print(Regex pattern);
 
+#ifdef RE_USE_STATS
+/* re_stats_attach: counts every search with pattern in stats from now on, or stops counting if stats is NULL */
+/* the counters are added to without locking, so a regex with stats mustn't be matched by several threads at once; give each call its own stats in re_match_opts instead */
+void re_stats_attach(Regex* pattern, re_stats* stats);
+/* re_stats_print: prints pattern like re_print, followed by the counters in stats */
+void re_stats_print(const Regex* pattern, const re_stats* stats);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
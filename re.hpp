@@ -0,0 +1,551 @@
+/*
+ * A C++20 front end to the regex module, for patterns that are known when the program is built:
+ *
+ *     size_t length;
+ *     size_t start = re::match<"\\d+-\\d+">(text, len, &length);
+ *
+ * The pattern is parsed by the compiler, with the same syntax as re_compile. If it only has chars, classes,
+ * \d \w \s and their inverses, ., ^, $, \b, \B and quantifiers, a matcher is generated for it, with every class
+ * a bitmap, every quantifier a loop over its own token and single chars compared directly. Any other pattern
+ * (groups, lookarounds, \R, modifiers, ...) is compiled by re_compilebuf the first time it is used and matched
+ * by re_matchn. Either way the result is the same as re_matchn's, errno included; tests/fixed.cpp checks that.
+ *
+ * The generated matcher backtracks, so on texts made to be slow it could take polynomial time; it gives up after
+ * MAXSTEPSPERCHAR steps per char of the text and leaves the text to re_matchn, so it never takes much longer than
+ * re_matchn itself. The classes are those of the "C" locale, so with RE_USE_LOCALE every pattern goes to re_matchn.
+ */
+
+#ifndef RE_HPP
+#define RE_HPP
+
+#if __cplusplus < 202002L
+#error "re.hpp needs C++20"
+#endif
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "re.h"
+
+namespace re {
+
+/* fixed_string: a string literal that can be given as a template argument */
+template <std::size_t N>
+struct fixed_string
+{
+	char chars[N];
+
+	constexpr fixed_string(const char (&s)[N])
+	{
+		for (std::size_t i = 0; i < N; ++i)
+			chars[i] = s[i];
+	}
+};
+
+namespace detail {
+
+/* most steps (tokens tried, or chars looked at by a quantifier) per char of the text that the generated matcher takes before it gives up */
+inline constexpr std::size_t MAXSTEPSPERCHAR = 16;
+
+/* the kinds of tokens the generated matcher knows */
+enum class kind : unsigned char
+{
+	set,         /* eats one char out of bits */
+	start,       /* ^ */
+	end,         /* $ */
+	boundary,    /* \b */
+	nonboundary, /* \B */
+};
+
+struct token
+{
+	kind type;
+	std::uint64_t bits[4]; /* set: the chars it eats */
+	bool single; /* set: whether it only eats ch, so that it can be compared directly */
+	char ch;
+	std::uint16_t min; /* the quantifier, with QUANTIFIERMAX for no limit, like re_Token */
+	std::uint16_t max;
+	bool greedy;
+	bool atomic;
+};
+
+/* a parsed pattern; N is the size of the pattern, which is more than it can have tokens */
+template <std::size_t N>
+struct program
+{
+	token tokens[N];
+	std::size_t ntokens = 0;
+	bool supported = true; /* whether the generated matcher can match the pattern, otherwise re_matchn does */
+	bool anchored = false; /* whether the pattern starts with ^ */
+	std::size_t minlength = 0; /* fewest chars that a match eats */
+	std::size_t first = SIZE_MAX; /* the token that eats the first char of every match, if there is one */
+};
+
+/* these are the classes of chartypes in re.c, for the "C" locale */
+constexpr bool isdigit(unsigned char c) { return c >= '0' && c <= '9'; }
+constexpr bool isspace(unsigned char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+constexpr bool isword(unsigned char c) { return isdigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+
+constexpr void addchar(token& t, unsigned char c) { t.bits[c >> 6] |= std::uint64_t(1) << (c & 63); }
+
+/* addmeta: adds the chars of \s \S \d \D \w \W or . to t, returns false for any other meta */
+constexpr bool addmeta(token& t, char meta)
+{
+	for (unsigned c = 0; c < 256; ++c) {
+		bool in = false;
+		switch (meta) {
+			case 's': in =  isspace(c); break;
+			case 'S': in = !isspace(c); break;
+			case 'd': in =  isdigit(c); break;
+			case 'D': in = !isdigit(c); break;
+			case 'w': in =  isword(c);  break;
+			case 'W': in = !isword(c);  break;
+			case '.': in = c != '\n';   break;
+			default: return false;
+		}
+		if (in)
+			addchar(t, (unsigned char)c);
+	}
+	return true;
+}
+
+/* addrange: adds the chars from first to last to t, compared as chars like matchoneclc does */
+constexpr void addrange(token& t, char first, char last)
+{
+	for (unsigned c = 0; c < 256; ++c) {
+		if ((char)c >= first && (char)c <= last)
+			addchar(t, (unsigned char)c);
+	}
+}
+
+/* parseclass: parses the class that starts at s[i], the char after the [, the way compileone does, returns the index after the ] */
+template <std::size_t N>
+constexpr std::size_t parseclass(const char (&s)[N], std::size_t i, token& t, bool& supported)
+{
+	bool inverted = false;
+	if (s[i] == '^') {
+		inverted = true;
+		++i;
+	}
+	token in{};
+	while (s[i] && s[i] != ']') {
+		char first;
+		if (s[i] == '\\') {
+			if (!s[i+1]) {
+				supported = false;
+				return i;
+			}
+			if (s[i+1] == 'R' || s[i+1] == 'b' || s[i+1] == 'B') {
+				/* these depend on the chars around them */
+				supported = false;
+				return i;
+			}
+			if (s[i+1] != '.' && addmeta(in, s[i+1])) {
+				i += 2;
+				if (s[i] == '-') {
+					/* a range from a metabsl, which re_compile turns down */
+					supported = false;
+					return i;
+				}
+				continue;
+			}
+			first = s[i+1];
+			i += 2;
+		} else {
+			first = s[i];
+			i += 1;
+		}
+		/* the same cases as compilerange */
+		char last = first;
+		if (s[i] == '-') {
+			if (s[i+1] == '\\' || s[i+1] == '\0') {
+				/* re_compile turns these down, or goes on in a way that is best left to it */
+				supported = false;
+				return i;
+			} else if (s[i+1] != ']') {
+				last = s[i+1];
+				i += 2;
+			}
+		}
+		addrange(in, first, last);
+	}
+	if (!s[i]) {
+		/* doesn't close the [ */
+		supported = false;
+		return i;
+	}
+	for (unsigned k = 0; k < 4; ++k)
+		t.bits[k] = inverted ? ~in.bits[k] : in.bits[k];
+	return i+1;
+}
+
+/* parsenumber: adds a digit to a quantifier the way compilequantifier does, returns false if it gets too large, which re_compile turns down */
+constexpr bool parsenumber(std::uint16_t& n, char digit)
+{
+	if (n > (QUANTIFIERMAX - 1 - (digit - '0')) / 10)
+		return false;
+	n = (std::uint16_t)(n * 10 + (digit - '0'));
+	return true;
+}
+
+/* parsequantifier: parses the quantifier at s[i], if there is one, the way compilequantifier does, returns the index after it */
+template <std::size_t N>
+constexpr std::size_t parsequantifier(const char (&s)[N], std::size_t i, token& t, bool& supported)
+{
+	t.min = 1;
+	t.max = 1;
+	switch (s[i]) {
+		case '?': t.min = 0; t.max = 1;             return i+1;
+		case '*': t.min = 0; t.max = QUANTIFIERMAX; return i+1;
+		case '+': t.min = 1; t.max = QUANTIFIERMAX; return i+1;
+		case '{': break;
+		default:  return i;
+	}
+	std::uint16_t min = 0;
+	std::size_t j = i+1;
+	for (; s[j]; ++j) {
+		if (isdigit(s[j])) {
+			if (!parsenumber(min, s[j])) {
+				supported = false;
+				return i;
+			}
+		} else if (s[j] == ',') {
+			++j;
+			if (s[j] == '}') {
+				t.min = min;
+				t.max = QUANTIFIERMAX;
+				return j+1;
+			}
+			break;
+		} else if (s[j] == '}') {
+			t.min = t.max = min;
+			return j+1;
+		} else {
+			/* not a quantifier; the { is a char */
+			return i;
+		}
+	}
+	std::uint16_t max = 0;
+	for (; s[j]; ++j) {
+		if (isdigit(s[j])) {
+			if (!parsenumber(max, s[j])) {
+				supported = false;
+				return i;
+			}
+		} else if (s[j] == '}') {
+			t.min = min;
+			t.max = max;
+			return j+1;
+		} else {
+			return i;
+		}
+	}
+	/* the pattern ends on an open {, which re_compile leaves half parsed */
+	supported = false;
+	return i;
+}
+
+/* parse: parses a pattern into the tokens of the generated matcher, the way compiletokens does */
+template <std::size_t N>
+constexpr program<N> parse(const char (&s)[N])
+{
+	program<N> p{};
+	std::size_t i = 0;
+	while (s[i] && p.supported) {
+		token t{};
+		t.type = kind::set;
+		switch (s[i]) {
+			case '\\':
+				if (!s[i+1] || s[i+1] == 'R') {
+					p.supported = false;
+					break;
+				}
+				if (s[i+1] == 'b')
+					t.type = kind::boundary;
+				else if (s[i+1] == 'B')
+					t.type = kind::nonboundary;
+				else if (s[i+1] == '.' || !addmeta(t, s[i+1]))
+					/* an escaped char */
+					addchar(t, (unsigned char)s[i+1]);
+				i += 2;
+				break;
+			case '[':
+				i = parseclass(s, i+1, t, p.supported);
+				break;
+			case '(': /* FALLTHROUGH */
+			case ')':
+				/* groups, lookarounds and modifiers are left to re_matchn */
+				p.supported = false;
+				break;
+			case '^':
+				t.type = kind::start;
+				++i;
+				break;
+			case '$':
+				t.type = kind::end;
+				++i;
+				break;
+			case '.':
+				addmeta(t, '.');
+				++i;
+				break;
+			default:
+				addchar(t, (unsigned char)s[i]);
+				++i;
+				break;
+		}
+		if (!p.supported)
+			break;
+		i = parsequantifier(s, i, t, p.supported);
+		t.greedy = s[i] != '?';
+		if (!t.greedy)
+			++i;
+		t.atomic = s[i] == '+';
+		if (t.atomic)
+			++i;
+
+		if (t.type == kind::set) {
+			/* a set of one char is compared directly */
+			unsigned count = 0;
+			for (unsigned c = 0; c < 256; ++c) {
+				if ((t.bits[c >> 6] >> (c & 63)) & 1) {
+					++count;
+					t.ch = (char)c;
+				}
+			}
+			t.single = count == 1;
+			p.minlength += t.min;
+		}
+		if (p.ntokens == 0 && t.type == kind::start && t.min > 0)
+			p.anchored = true;
+		p.tokens[p.ntokens++] = t;
+	}
+	/* only zero-width tokens can come before it, and it can't be skipped */
+	std::size_t k = 0;
+	while (k < p.ntokens && p.tokens[k].type != kind::set)
+		++k;
+	if (p.supported && k < p.ntokens && p.tokens[k].min > 0)
+		p.first = k;
+#ifdef RE_USE_LOCALE
+	p.supported = false;
+#endif
+	return p;
+}
+
+inline bool iswordat(const char* text, std::size_t len, std::size_t i)
+{
+	return i < len && isword((unsigned char)text[i]);
+}
+
+/* matcher: the matcher generated for a parsed pattern P, one function per token */
+template <const auto& P>
+struct matcher
+{
+	template <std::size_t I>
+	static bool in(char c)
+	{
+		constexpr token t = P.tokens[I];
+		if constexpr (t.single) {
+			return c == t.ch;
+		} else {
+			const unsigned char uc = (unsigned char)c;
+			return (t.bits[uc >> 6] >> (uc & 63)) & 1;
+		}
+	}
+
+	/* step: matches the tokens from I on at index i of text, returns whether they match and stores where in end */
+	/* every token tried and every char looked at takes one of steps; once there are none left, nothing matches */
+	template <std::size_t I>
+	static bool step(const char* text, std::size_t len, std::size_t i, std::size_t& end, std::size_t& steps)
+	{
+		if (!steps)
+			return false;
+		--steps;
+		if constexpr (I == P.ntokens) {
+			end = i;
+			return true;
+		} else {
+			constexpr token t = P.tokens[I];
+			if constexpr (t.type != kind::set) {
+				/* repeating a zero-width token gets nowhere, so only whether it has to hold matters */
+				if constexpr (t.min > 0) {
+					bool holds;
+					if constexpr (t.type == kind::start)
+						holds = i == 0;
+					else if constexpr (t.type == kind::end)
+						holds = i == len;
+					else if constexpr (t.type == kind::boundary)
+						holds = iswordat(text, len, i-1) != iswordat(text, len, i);
+					else
+						holds = iswordat(text, len, i-1) == iswordat(text, len, i);
+					if (!holds)
+						return false;
+				}
+				return step<I+1>(text, len, i, end, steps);
+			} else if constexpr (t.min == 1 && t.max == 1) {
+				return i < len && in<I>(text[i]) && step<I+1>(text, len, i+1, end, steps);
+			} else {
+				constexpr std::size_t max = t.max == QUANTIFIERMAX ? SIZE_MAX : t.max;
+				const std::size_t room = max < len - i ? max : len - i;
+				if constexpr (t.greedy) {
+					std::size_t n = 0;
+					while (n < room && in<I>(text[i+n]))
+						++n;
+					steps -= n < steps ? n : steps;
+					if (n < t.min)
+						return false;
+					if constexpr (t.atomic)
+						return step<I+1>(text, len, i+n, end, steps);
+					for (std::size_t c = n + 1; c-- > t.min;) {
+						if (step<I+1>(text, len, i+c, end, steps))
+							return true;
+					}
+					return false;
+				} else {
+					for (std::size_t c = 0; c < t.min; ++c) {
+						if (c >= room || !in<I>(text[i+c]))
+							return false;
+					}
+					steps -= t.min < steps ? t.min : steps;
+					if constexpr (t.atomic)
+						/* the backtracker never tries more than the fewest */
+						return step<I+1>(text, len, i+t.min, end, steps);
+					for (std::size_t c = t.min;; ++c) {
+						if (step<I+1>(text, len, i+c, end, steps))
+							return true;
+						if (c >= room || !in<I>(text[i+c]))
+							return false;
+					}
+				}
+			}
+		}
+	}
+
+	/* search: returns the index of the first match in text and stores its length, or returns SIZE_MAX */
+	/* sets gaveup if it ran out of steps, and then the result is not known */
+	static std::size_t search(const char* text, std::size_t len, std::size_t* length, bool& gaveup)
+	{
+		gaveup = false;
+		if (len < P.minlength)
+			return SIZE_MAX;
+		std::size_t steps = MAXSTEPSPERCHAR * (len + 1);
+		const std::size_t last = P.anchored ? 0 : len - P.minlength;
+		for (std::size_t i = 0; i <= last; ++i) {
+			if constexpr (P.first != SIZE_MAX && P.tokens[P.first].single) {
+				/* every match starts with the same char */
+				const void* next = std::memchr(text + i, P.tokens[P.first].ch, last + 1 - i);
+				if (!next)
+					return SIZE_MAX;
+				i = (std::size_t)((const char*)next - text);
+			} else if constexpr (P.first != SIZE_MAX) {
+				while (i <= last && !in<P.first>(text[i]))
+					++i;
+				if (i > last)
+					return SIZE_MAX;
+			}
+			std::size_t end;
+			if (step<0>(text, len, i, end, steps)) {
+				*length = end - i;
+				return i;
+			}
+			if (!steps) {
+				gaveup = true;
+				return SIZE_MAX;
+			}
+		}
+		return SIZE_MAX;
+	}
+};
+
+} /* namespace detail */
+
+/* static_regex: a pattern that is parsed at compile time */
+template <fixed_string Pattern>
+struct static_regex
+{
+	static constexpr detail::program<sizeof(Pattern.chars)> program = detail::parse(Pattern.chars);
+	/* whether the pattern is matched by the code generated for it; if not, it is matched by re_matchn */
+	static constexpr bool specialised = program.supported;
+
+	/* match: same as re_matchn */
+	static std::size_t match(const char* text, std::size_t len, std::size_t* length = nullptr)
+	{
+		if constexpr (specialised) {
+			std::size_t lengthBuf;
+			bool gaveup;
+			const std::size_t start = detail::matcher<program>::search(text, len, &lengthBuf, gaveup);
+			if (gaveup)
+				return matchfallback(text, len, length);
+			if (start == SIZE_MAX) {
+				errno = EINVAL;
+				return 0;
+			}
+			errno = 0;
+			if (length)
+				*length = lengthBuf;
+			return start;
+		} else {
+			return matchfallback(text, len, length);
+		}
+	}
+
+	/* match: same as re_matchp, for a null-terminated text */
+	static std::size_t match(const char* text, std::size_t* length = nullptr)
+	{
+		return match(text, std::strlen(text), length);
+	}
+
+private:
+	struct Compiled
+	{
+		Regex regex;
+		int error; /* errno after compiling */
+		/* a pattern has fewer tokens and class chars than it has chars; the automata come after them, aligned for NfaInst */
+		alignas(std::max_align_t) unsigned char buf[sizeof(Pattern.chars) * (sizeof(re_Token) + sizeof(ClassChar)) + sizeof(NfaInst) + MAXAUTOMATALEN];
+	};
+
+	/* matchfallback: matches text with re_matchn */
+	static std::size_t matchfallback(const char* text, std::size_t len, std::size_t* length)
+	{
+		const Compiled& compiled = fallback();
+		if (compiled.error) {
+			errno = compiled.error;
+			return 0;
+		}
+		return re_matchn(&compiled.regex, text, len, length);
+	}
+
+	/* fallback: the pattern compiled by re_compilebuf, the first time it is needed */
+	static const Compiled& fallback()
+	{
+		/* the Regex points into itself and buf, so it is compiled in place; only the initialization of done is guarded against other threads */
+		static Compiled compiled;
+		static const bool done = [] {
+			re_compilebuf(&compiled.regex, Pattern.chars, compiled.buf, sizeof(compiled.buf));
+			compiled.error = errno;
+			return true;
+		}();
+		(void)done;
+		return compiled;
+	}
+};
+
+/* match: matches Pattern against text, which is len chars long, the same as re_matchn */
+template <fixed_string Pattern>
+std::size_t match(const char* text, std::size_t len, std::size_t* length = nullptr)
+{
+	return static_regex<Pattern>::match(text, len, length);
+}
+
+/* match: same as the other match, for a null-terminated text */
+template <fixed_string Pattern>
+std::size_t match(const char* text, std::size_t* length = nullptr)
+{
+	return static_regex<Pattern>::match(text, length);
+}
+
+} /* namespace re */
+
+#endif /* RE_HPP */
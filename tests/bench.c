@@ -0,0 +1,394 @@
+/*
+ * A benchmark suite: times a matrix of patterns over a few corpora, and prints the results as CSV or JSON.
+ *
+ * Usage: tests/bench [-json] [-trials N] [-size BYTES] [FILE...]
+ *
+ * Without files, a random corpus and a log-like corpus of BYTES bytes are generated; each file given is mapped
+ * into memory and used as a corpus of its own. Every pattern is run once over every corpus to warm up, then N
+ * times; the fastest trial is reported. Build with -DRE_BENCH_PCRE2 and -lpcre2-8 to also time PCRE2 on the same
+ * patterns and corpora.
+ *
+ * Every corpus is also cut into short fields of 8 to 32 chars, which are matched with one re_match_batch call
+ * (engine re-batch), with a re_match call for each (engine re-match) and with a re_matchn call for each (engine
+ * re-matchn); matches counts the fields that match.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef RE_BENCH_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
+
+#include "re.h"
+
+typedef struct Bench
+{
+	const char* name;
+	const char* pattern;
+} Bench;
+
+Bench benchvector[] =
+{
+	{ "literal",            "request"                   },
+	{ "literal-none",       "nonexisting"               },
+	{ "literal-fold",       "(?i:error)"                },
+	{ "anchored",           "^2026"                     },
+	{ "class",              "[0-9]+"                    },
+	{ "word",               "\\w+"                      },
+	{ "greedy",             "id=.*ms"                   },
+	{ "lazy",               "id=.*?ms"                  },
+	{ "atomic",             "\\d++ms"                   },
+	{ "lookahead",          "\\w+(?=:)"                 },
+	{ "negative-lookahead", "\\b\\d+\\b(?!\\.)"         },
+	{ "group",              "(?:\\d+\\.){3}\\d+"        },
+	{ "ip",                 "\\d+\\.\\d+\\.\\d+\\.\\d+" },
+	{ "pathological",       ".+nonexisting.+"           },
+};
+
+typedef struct Corpus
+{
+	const char* name;
+	const char* text;
+	size_t len;
+	size_t mapped; /* length of the mapping to release, or 0 if text was allocated */
+} Corpus;
+
+/* a corpus cut into short null-terminated texts */
+typedef struct Fields
+{
+	Corpus corpus; /* the name and total length of the fields */
+	char name[64];
+	char* buf; /* the fields, one after another with a NUL after each */
+	const char** texts; /* where each field starts in buf */
+	size_t n; /* number of fields */
+} Fields;
+
+/* the ways of matching the fields */
+typedef enum Loop
+{
+	LOOP_BATCH, /* one re_match_batch call */
+	LOOP_MATCH, /* re_match on each, which copies the Regex */
+	LOOP_MATCHN /* re_matchn on each */
+} Loop;
+
+typedef struct Result
+{
+	double seconds; /* of the fastest trial */
+	size_t matches;
+} Result;
+
+static unsigned long seed = 12345;
+
+/* rnd: returns a pseudo random number below n, the same on every run */
+static size_t rnd(size_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+/* genrandom: fills len chars of random printable text, with a newline now and then */
+static char* genrandom(size_t len)
+{
+	char* text = malloc(len + 1);
+	if (!text)
+		return NULL;
+	for (size_t i = 0; i < len; ++i)
+		text[i] = rnd(64) ? (char)(' ' + rnd(95)) : '\n';
+	text[len] = '\0';
+	return text;
+}
+
+/* genlog: fills len chars with lines which look like those of a server log */
+static char* genlog(size_t len)
+{
+	static const char* levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+	static const char* events[] = { "request served", "cache miss", "connection reset", "retrying request" };
+	char* text = malloc(len + 1);
+	if (!text)
+		return NULL;
+	size_t i = 0;
+	while (i < len) {
+		char line[160];
+		const int n = snprintf(line, sizeof(line),
+		                       "2026-%02u-%02u %02u:%02u:%02u %s worker-%u: %s id=%u took %ums from %u.%u.%u.%u\n",
+		                       (unsigned)rnd(12) + 1, (unsigned)rnd(28) + 1, (unsigned)rnd(24), (unsigned)rnd(60),
+		                       (unsigned)rnd(60), levels[rnd(6)], (unsigned)rnd(16), events[rnd(4)],
+		                       (unsigned)rnd(100000), (unsigned)rnd(2000), (unsigned)rnd(256), (unsigned)rnd(256),
+		                       (unsigned)rnd(256), (unsigned)rnd(256));
+		const size_t take = (size_t)n < len - i ? (size_t)n : len - i;
+		memcpy(text + i, line, take);
+		i += take;
+	}
+	text[len] = '\0';
+	return text;
+}
+
+/* mapfile: maps the file at path into corpus, returns whether it was possible */
+static bool mapfile(Corpus* corpus, const char* path)
+{
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* text = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (text == MAP_FAILED)
+		return false;
+	corpus->name = path;
+	corpus->text = text;
+	corpus->len = (size_t)st.st_size;
+	corpus->mapped = (size_t)st.st_size;
+	return true;
+}
+
+/* genfields: cuts corpus into fields, returns whether there was enough memory */
+static bool genfields(Fields* fields, const Corpus* corpus)
+{
+	fields->buf = malloc(corpus->len * 2 + 1);
+	fields->texts = malloc((corpus->len / 8 + 1) * sizeof(*fields->texts));
+	if (!fields->buf || !fields->texts)
+		return false;
+	fields->n = 0;
+	size_t len = 0;
+	char* out = fields->buf;
+	for (size_t i = 0; i < corpus->len;) {
+		size_t n = 8 + rnd(25);
+		if (n > corpus->len - i)
+			n = corpus->len - i;
+		/* a NUL in a mapped file would end the field early, so the length is counted as re_match sees it */
+		fields->texts[fields->n++] = out;
+		memcpy(out, corpus->text + i, n);
+		out[n] = '\0';
+		len += strlen(out);
+		out += n + 1;
+		i += n;
+	}
+	snprintf(fields->name, sizeof(fields->name), "%s-fields", corpus->name);
+	fields->corpus = (Corpus){ fields->name, fields->buf, len, 0 };
+	return true;
+}
+
+/* elapsed: returns the seconds since start */
+static double elapsed(clock_t start)
+{
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* runre: counts the matches of pattern in corpus, trials times after a warmup run */
+static Result runre(const Regex* pattern, const Corpus* corpus, size_t trials)
+{
+	Result result = { 0, 0 };
+	for (size_t t = 0; t <= trials; ++t) {
+		RegexIter iter;
+		size_t matches = 0;
+		const clock_t start = clock();
+		re_find_init(&iter, pattern, corpus->text, corpus->len);
+		while (re_find_iter(&iter, NULL, 0))
+			++matches;
+		const double seconds = elapsed(start);
+		/* the first run only warms up the caches */
+		if (t == 1 || (t > 1 && seconds < result.seconds))
+			result.seconds = seconds;
+		result.matches = matches;
+	}
+	return result;
+}
+
+/* runfields: counts the fields that pattern matches, in the way given by loop */
+static Result runfields(const Regex* pattern, const Fields* fields, re_result* results, size_t trials, Loop loop)
+{
+	Result result = { 0, 0 };
+	for (size_t t = 0; t <= trials; ++t) {
+		size_t matches = 0;
+		const clock_t start = clock();
+		if (loop == LOOP_BATCH) {
+			matches = re_match_batch(pattern, fields->texts, NULL, fields->n, results);
+		} else {
+			for (size_t f = 0; f < fields->n; ++f) {
+				size_t length;
+				if (loop == LOOP_MATCH)
+					results[f].start = re_match(*pattern, fields->texts[f], &length);
+				else
+					results[f].start = re_matchn(pattern, fields->texts[f], strlen(fields->texts[f]), &length);
+				results[f].length = length;
+				if (!errno)
+					++matches;
+			}
+		}
+		const double seconds = elapsed(start);
+		if (t == 1 || (t > 1 && seconds < result.seconds))
+			result.seconds = seconds;
+		result.matches = matches;
+	}
+	return result;
+}
+
+#ifdef RE_BENCH_PCRE2
+/* runpcre2: like runre, but with PCRE2 */
+static Result runpcre2(const pcre2_code* pattern, const Corpus* corpus, size_t trials)
+{
+	Result result = { 0, 0 };
+	pcre2_match_data* md = pcre2_match_data_create(1, NULL);
+	for (size_t t = 0; t <= trials; ++t) {
+		size_t matches = 0;
+		size_t from = 0;
+		const clock_t start = clock();
+		while (from <= corpus->len && pcre2_match(pattern, (PCRE2_SPTR8)corpus->text, corpus->len, from, 0, md, NULL) >= 0) {
+			const PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(md);
+			++matches;
+			/* step over empty matches, like re_find_iter does */
+			from = ovector[1] > ovector[0] ? ovector[1] : ovector[1] + 1;
+		}
+		const double seconds = elapsed(start);
+		if (t == 1 || (t > 1 && seconds < result.seconds))
+			result.seconds = seconds;
+		result.matches = matches;
+	}
+	pcre2_match_data_free(md);
+	return result;
+}
+#endif
+
+/* report: prints one result as a CSV line or JSON object */
+static void report(bool json, bool first, const char* engine, const Bench* bench, const Corpus* corpus, Result result)
+{
+	/* clock() may not have ticked for very fast runs */
+	const double seconds = result.seconds > 0 ? result.seconds : 1.0 / CLOCKS_PER_SEC;
+	const double mbs = (double)corpus->len / seconds / 1e6;
+	const double nsmatch = result.matches ? seconds * 1e9 / result.matches : 0;
+	const double matchess = result.matches / seconds;
+	if (json)
+		printf("%s\n  {\"engine\": \"%s\", \"bench\": \"%s\", \"corpus\": \"%s\", \"bytes\": %zu, \"matches\": %zu, "
+		       "\"mb_per_s\": %.2f, \"ns_per_match\": %.1f, \"matches_per_s\": %.0f}",
+		       first ? "" : ",", engine, bench->name, corpus->name, corpus->len, result.matches, mbs, nsmatch, matchess);
+	else
+		printf("%s,%s,%s,%zu,%zu,%.2f,%.1f,%.0f\n",
+		       engine, bench->name, corpus->name, corpus->len, result.matches, mbs, nsmatch, matchess);
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	bool json = false;
+	size_t trials = 5;
+	size_t size = 1 << 20;
+	Corpus corpora[16];
+	size_t ncorpora = 0;
+	Fields fields[16];
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-json") == 0) {
+			json = true;
+		} else if (strcmp(argv[i], "-trials") == 0 && i + 1 < argc) {
+			trials = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+			size = strtoul(argv[++i], NULL, 10);
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr, "usage: %s [-json] [-trials N] [-size BYTES] [FILE...]\n", argv[0]);
+			return 1;
+		} else if (ncorpora < sizeof(corpora) / sizeof(*corpora)) {
+			if (!mapfile(&corpora[ncorpora], argv[i])) {
+				fprintf(stderr, "%s: can't map %s: %s\n", argv[0], argv[i], strerror(errno));
+				return 1;
+			}
+			++ncorpora;
+		}
+	}
+	if (trials == 0)
+		trials = 1;
+
+	if (ncorpora == 0) {
+		corpora[0] = (Corpus){ "random", genrandom(size), size, 0 };
+		corpora[1] = (Corpus){ "log", genlog(size), size, 0 };
+		ncorpora = 2;
+		if (!corpora[0].text || !corpora[1].text) {
+			fprintf(stderr, "%s: out of memory\n", argv[0]);
+			return 1;
+		}
+	}
+
+	size_t maxfields = 0;
+	for (size_t c = 0; c < ncorpora; ++c) {
+		if (!genfields(&fields[c], &corpora[c])) {
+			fprintf(stderr, "%s: out of memory\n", argv[0]);
+			return 1;
+		}
+		if (fields[c].n > maxfields)
+			maxfields = fields[c].n;
+	}
+	re_result* results = malloc((maxfields + 1) * sizeof(*results));
+	if (!results) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+
+	if (json)
+		printf("[");
+	else
+		printf("engine,bench,corpus,bytes,matches,mb_per_s,ns_per_match,matches_per_s\n");
+
+	bool first = true;
+	const size_t nbenches = sizeof(benchvector) / sizeof(*benchvector);
+	for (size_t i = 0; i < nbenches; ++i) {
+		const Bench* bench = &benchvector[i];
+		Regex re;
+		errno = 0;
+		re_compile(&re, bench->pattern);
+		if (errno) {
+			fprintf(stderr, "%s: can't compile '%s': %s\n", argv[0], bench->pattern, strerror(errno));
+			continue;
+		}
+#ifdef RE_BENCH_PCRE2
+		int errorcode;
+		PCRE2_SIZE erroroffset;
+		pcre2_code* pcreregex = pcre2_compile((PCRE2_SPTR8)bench->pattern, PCRE2_ZERO_TERMINATED, 0, &errorcode, &erroroffset, NULL);
+		if (pcreregex)
+			pcre2_jit_compile(pcreregex, PCRE2_JIT_COMPLETE);
+#endif
+		for (size_t c = 0; c < ncorpora; ++c) {
+			report(json, first, "re", bench, &corpora[c], runre(&re, &corpora[c], trials));
+			first = false;
+#ifdef RE_BENCH_PCRE2
+			if (pcreregex)
+				report(json, false, "pcre2", bench, &corpora[c], runpcre2(pcreregex, &corpora[c], trials));
+#endif
+		}
+		for (size_t c = 0; c < ncorpora; ++c) {
+			report(json, false, "re-batch", bench, &fields[c].corpus, runfields(&re, &fields[c], results, trials, LOOP_BATCH));
+			report(json, false, "re-match", bench, &fields[c].corpus, runfields(&re, &fields[c], results, trials, LOOP_MATCH));
+			report(json, false, "re-matchn", bench, &fields[c].corpus, runfields(&re, &fields[c], results, trials, LOOP_MATCHN));
+		}
+#ifdef RE_BENCH_PCRE2
+		pcre2_code_free(pcreregex);
+#endif
+	}
+
+	if (json)
+		printf("\n]\n");
+
+	free(results);
+	for (size_t c = 0; c < ncorpora; ++c) {
+		free(fields[c].buf);
+		free(fields[c].texts);
+		if (corpora[c].mapped)
+			munmap((void*)corpora[c].text, corpora[c].mapped);
+		else
+			free((void*)corpora[c].text);
+	}
+	return 0;
+}
@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -18,117 +19,291 @@ typedef struct Test
 
 Test testvector[] =
 {
-	{ false , "a"                        , ""                       },
-	{ true  , "a*"                       , ""                       },
-	{ false , "[^s][^b]"                 , "a"                      },
-	{ false , "[^\\d]+\\s"               , "e"                      },
-	{ true  , "\\d"                      , "5"                      },
-	{ false , "\\d+"                     , "y"                      },
-	{ true  , "\\w+"                     , "hej"                    },
-	{ true  , "\\s"                      , "\t \n"                  },
-	{ false , "\\S"                      , "\t \n"                  },
-	{ true  , "[\\s]"                    , "\t \n"                  },
-	{ false , "[\\S]"                    , "\t \n"                  },
-	{ false , "\\D"                      , "5"                      },
-	{ false , "\\W+"                     , "hej"                    },
-	{ true  , "[0-9]+"                   , "12345"                  },
-	{ true  , "\\D"                      , "hej"                    },
-	{ false , "\\d"                      , "hej"                    },
-	{ true  , "[^\\w]"                   , "\\"                     },
-	{ true  , "[\\W]"                    , "\\"                     },
-	{ false , "[\\w]"                    , "\\"                     },
-	{ true  , "[^\\d]"                   , "d"                      },
-	{ false , "[\\d]"                    , "d"                      },
-	{ false , "[^\\D]"                   , "d"                      },
-	{ true  , "[\\D]"                    , "d"                      },
-	{ true  , "a+a"                      , "aaa"                    },
-	{ true  , "^.*\\\\.*$"               , "c:\\Tools"              },
-	{ true  , "^[\\+-]*[\\d]+$"          , "+27"                    },
-	{ true  , "[abc]"                    , "1c2"                    },
-	{ false , "[abc]"                    , "1C2"                    },
-	{ true  , "[1-5]+"                   , "0123456789"             },
-	{ true  , "[.2]"                     , "1C2"                    },
-	{ true  , "a*$"                      , "Xaa"                    },
-	{ true  , "[a-h]+"                   , "abcdefghxxx"            },
-	{ false , "[a-h]+"                   , "ABCDEFGH"               },
-	{ true  , "[A-H]+"                   , "ABCDEFGH"               },
-	{ false , "[A-H]+"                   , "abcdefgh"               },
-	{ true  , "[^\\s]+"                  , "abc def"                },
-	{ true  , "[^fc]+"                   , "abc def"                },
-	{ true  , "[^d\\sf]+"                , "abc def"                },
-	{ true  , "\n"                       , "abc\ndef"               },
-	{ true  , "b.\\s*\n"                 , "aa\r\nbb\r\ncc\r\n\r\n" },
-	{ true  , ".*c"                      , "abcabc"                 },
-	{ true  , ".+c"                      , "abcabc"                 },
-	{ true  , "[b-z].*"                  , "ab"                     },
-	{ true  , "b[k-z]*"                  , "ab"                     },
-	{ false , "[0-9]"                    , "  - "                   },
-	{ true  , "[^0-9]"                   , "  - "                   },
-	{ true  , "0|"                       , "0|"                     },
-	{ false , "\\d\\d:\\d\\d:\\d\\d"     , "0s:00:00"               },
-	{ false , "\\d\\d:\\d\\d:\\d\\d"     , "000:00"                 },
-	{ false , "\\d\\d:\\d\\d:\\d\\d"     , "00:0000"                },
-	{ false , "\\d\\d:\\d\\d:\\d\\d"     , "100:0:00"               },
-	{ false , "\\d\\d:\\d\\d:\\d\\d"     , "00:100:00"              },
-	{ false , "\\d\\d:\\d\\d:\\d\\d"     , "0:00:100"               },
-	{ true  , "\\d\\d?:\\d\\d?:\\d\\d?"  , "0:0:0"                  },
-	{ true  , "\\d\\d?:\\d\\d?:\\d\\d?"  , "0:00:0"                 },
-	{ true  , "\\d\\d?:\\d\\d?:\\d\\d?"  , "0:0:00"                 },
-	{ true  , "\\d\\d?:\\d\\d?:\\d\\d?"  , "00:0:0"                 },
-	{ true  , "\\d\\d?:\\d\\d?:\\d\\d?"  , "00:00:0"                },
-	{ true  , "\\d\\d?:\\d\\d?:\\d\\d?"  , "00:0:00"                },
-	{ true  , "\\d\\d?:\\d\\d?:\\d\\d?"  , "0:00:00"                },
-	{ true  , "\\d\\d?:\\d\\d?:\\d\\d?"  , "00:00:00"               },
-	{ true  , "[Hh]ello [Ww]orld\\s*[!]?", "Hello world !"          },
-	{ true  , "[Hh]ello [Ww]orld\\s*[!]?", "hello world !"          },
-	{ true  , "[Hh]ello [Ww]orld\\s*[!]?", "Hello World !"          },
-	{ true  , "[Hh]ello [Ww]orld\\s*[!]?", "Hello world!   "        },
-	{ true  , "[Hh]ello [Ww]orld\\s*[!]?", "Hello world    !"       },
-	{ true  , "[Hh]ello [Ww]orld\\s*[!]?", "hello World      !"     },
-	{ false , "\\d\\d?:\\d\\d?:\\d\\d?"  , "a:0"                    },
-	{ true  , "[^\\w][^-1-4]"            , ")T"                     },
-	{ true  , "[^\\w][^-1-4]"            , ")^"                     },
-	{ true  , "[^\\w][^-1-4]"            , "*)"                     },
-	{ true  , "[^\\w][^-1-4]"            , "!."                     },
-	{ true  , "[^\\w][^-1-4]"            , " x"                     },
-	{ true  , "[^\\w][^-1-4]"            , "$b"                     },
-	{ true  , ".?bar"                    , "real_bar"               },
-	{ false , ".?bar"                    , "real_foo"               },
-	{ false , "X?Y"                      , "Z"                      },
-	{ true  , "\\d+\\w?12"               , "959312"                 },
-	{ true  , "\\d+5"                    , "12345"                  },
-	{ false , "\\d++5"                   , "12345"                  },
-	{ false , "abcd"                     , "aBcD"                   },
-	{ true  , "(?i:abcd)"                , "aBcD"                   },
-	{ false , "..."                      , "\n \n"                  },
-	{ true  , "(?s:...)"                 , "\n \n"                  },
-	{ false , "(?s:(?-s:.))"             , "\n"                     },
-	{ true  , "(?is:A.)"                 , "a\n"                    },
-	{ false , "(?is:(?-is:.g.))"         , "\nG\n"                  },
-	{ true  , "(?is:(?-is:.g.))"         , "\ng\n"                  },
-	{ false , "abc\\bdef"                , "abcdef"                 },
-	{ true  , "abc\\Bdef"                , "abcdef"                 },
-	{ true  , "\\Bing\\b"                , "joining."               },
-	{ false , "\\Bing\\b"                , " ing "                  },
-	{ false,  "\\Bing\\b"                , "ing"                    },
-	{ false , "\\Bing\\b"                , "bingg"                  },
-	{ true  , "abc\\Rdef"                , "abc\r\ndef"             },
-	{ true  , "abc\\Rdef"                , "abc\ndef"               },
-	{ false , "abc\n\\Rdef"              , "abc\ndef"               },
-	{ true  , "abc\r\\Rdef"              , "abc\r\ndef"             },
-	{ true  , "^(a+)a$"                  , "aaa"                    },
-	{ true  , "^a(a*)a$"                 , "aa"                     },
-	{ true  , "^(a)+a$"                  , "aaa"                    },
-	{ true  , "^(Hello){3}(World){1,2}$" , "HelloHelloHelloWorld"   },
-	{ true  , "^(is:[ab])+?bc$"          , "aAaAaaAAaaAAAAbAaaAbc"  },
-	{ true  , "(?=.*ghi)abc"             , "abcdefghi"              },
-	{ true  , "(?s=.*END)BEGIN"          , "BEGIN..content..\nEND"  },
-	{ false , "(?s=.*END)BEGIN"          , "BEGIN..content..\n"     },
-	{ false , "(?s!.*END)BEGIN"          , "BEGIN..content..\nEND"  },
-	{ true  , "(?s!.*END)BEGIN"          , "BEGIN..content..\n"     },
-	{ false , "(b*){1}+b"                , "bbbbb"                  },
+#define TEST(shouldsucceed, pattern, text) { shouldsucceed, pattern, text },
+#include "testvector.h"
+#undef TEST
 };
 
+typedef struct CaptureTest
+{
+	char* pattern;
+	char* text;
+	size_t group; /* the capturing group to check */
+	size_t start; /* where it should start, or SIZE_MAX if it shouldn't take part in the match */
+	size_t length;
+} CaptureTest;
+
+CaptureTest capturevector[] =
+{
+	{ "(\\w+)@(\\w+)\\.com"        , "mail bob@example.com"  , 2, 9       , 7 },
+	{ "(?:(\\d)x)+"                , "1x2x3y"                , 1, 2       , 1 },
+	{ "(?:(a)b)*a"                 , "abac"                  , 1, 0       , 1 },
+	{ "(a)?b"                      , "b"                     , 1, SIZE_MAX, 0 },
+	{ "(a+)(?=(b))"                , "xaab"                  , 2, 3       , 1 },
+	{ "((a)(b))+"                  , "abab"                  , 2, 2       , 1 },
+	{ "(?<=(\\w)=)\\d"             , "x=1"                   , 1, 0       , 1 },
+};
+
+typedef struct
+{
+	char* pattern;
+	char* text;
+	size_t count; /* how many matches re_matchg should find */
+} GlobalTest;
+
+/* matches after the first one still see the whole text for anchors and \b */
+GlobalTest globalvector[] =
+{
+	{ "a"                          , "banana"                , 3 },
+	{ "^a"                         , "aaa"                   , 1 },
+	{ "\\bx"                       , "xx x"                  , 2 },
+	{ "\\Bx"                       , "xx x"                  , 1 },
+	{ "a*"                         , "baab"                  , 4 },
+	{ "$"                          , "ab"                    , 1 },
+	{ "(?=a)"                      , "aab"                   , 2 },
+	{ "a+"                         , "aaaabaaa"              , 2 },
+	{ "\\w+ \\w+"                  , "one two three four"    , 2 },
+	{ "(?<=a)a"                    , "aaa"                   , 2 },
+	{ "(?<!a)a"                    , "aaba"                  , 2 },
+	{ "\\d$"                       , "1 2 3"                 , 1 },
+};
+
+typedef struct
+{
+	char* pattern;
+	char* text;
+	size_t maxsteps; /* the step limit given to re_matchopts */
+	size_t worklen; /* the bytes of work space given to re_matchopts, or 0 for none */
+	int error; /* what errno should be afterwards */
+} BudgetTest;
+
+BudgetTest budgetvector[] =
+{
+	/* these end in a class rather than a char, which would be a required string that isn't in the text */
+	{ "(?:a*a*)*(?=c)[bd]"         , "aaaaaaaaaaaaaaaaaaaaaaac" , 100  , 0   , ETIMEDOUT },
+	{ "(?:a*a*)*(?=c)[bd]"         , "aaaaaac"                  , 0    , 0   , EINVAL    },
+	{ "(?=.*e)ab"                  , "xxabe"                    , 1000 , 0   , 0         },
+	{ "a+b"                        , "aaab"                     , 1    , 0   , ETIMEDOUT },
+	{ "(?i:a)+?_"                  , "aaab_a_"                  , 0    , 0   , 0         },
+	/* only finishes in time because the backtracker remembers where the rest of the regex failed */
+	{ "\\w*\\w*\\w*\\w*\\w*[!?](?=)", "aaaaaaaaaaaaaaaaaaaaaaaaa", 100000, 0, EINVAL    },
+	/* the backtracker's choices don't fit in 256 bytes, but do in the WORKLEN bytes of stack it has without them */
+	{ "(?=)(?:ab)+c"               , "abababababababababababc"  , 0    , 256 , ENOBUFS   },
+	{ "(?=)(?:ab)+c"               , "abababababababababababc"  , 0    , 0   , 0         },
+};
+
+typedef struct
+{
+	char* pattern;
+	size_t minlength; /* what re_info should find */
+	size_t maxlength;
+	bool linear;
+} InfoTest;
+
+InfoTest infovector[] =
+{
+	{ "abc"                        , 3       , 3       , true  },
+	{ "^a\\d{2,4}$"                , 3       , 5       , true  },
+	{ "(?:ab)+c?"                  , 2       , SIZE_MAX, true  },
+	{ "\\R\\b(?=xyz)"              , 1       , 2       , false },
+	{ "(a[bc])*"                   , 0       , SIZE_MAX, true  },
+	{ "\\w++x"                     , 2       , SIZE_MAX, false },
+};
+
+/* length of the runs of one char that the texts of runvector start with, well past what a Quantifier once counted to */
+#define RUNLEN 1000
+
+typedef struct
+{
+	char* pattern;
+	char c; /* the text is RUNLEN copies of c, then end */
+	char* end;
+	size_t start; /* where the match should start, or SIZE_MAX if there shouldn't be one */
+	size_t length;
+	size_t maxsteps; /* the step limit given to re_matchopts, or 0 for none */
+} RunTest;
+
+RunTest runvector[] =
+{
+	{ "\\w+"                       , 'a', "!", 0       , 1000, 0     },
+	{ "\\w+(?=!)"                  , 'a', "!", 0       , 1000, 0     },
+	{ "\\w++!"                     , 'a', "!", 0       , 1001, 0     },
+	{ "(?=x)?\\w*?!"               , 'a', "!", 0       , 1001, 0     },
+	{ "(?:aa)*(?=a)a"              , 'a', "" , 0       , 999 , 0     },
+	{ "a{300}"                     , 'a', "" , 0       , 300 , 0     },
+	/* a group of nothing but one token that eats a char is repeated like that token, without a record for each repetition */
+	{ "(?s:.)*+"                   , 'a', "!", 0       , 1001, 0     },
+	{ "(?=a)(?s:.){2,}+"           , 'a', "!", 0       , 1001, 0     },
+	{ "(?=a)a{256,300}b"           , 'a', "b", 700     , 301 , 0     },
+	/* a run is given back straight to where the token after it can match, not one char at a time */
+	{ "(?=a)\\w*\\d"               , 'a', "!", SIZE_MAX, 0   , 10000 },
+	{ "(?=a)\\w*?[!?]"             , 'a', ",", SIZE_MAX, 0   , 10000 },
+	/* the failures of nested quantifiers are remembered for each count of the groups they are in, so a miss takes steps linear in the length of the text */
+	{ "(?!x)a*a*a*a*a*[!][!]"      , 'a', "!", SIZE_MAX, 0   , 40000 },
+	{ "(?!x)(\\w*)*[!][!]"         , 'a', "!", SIZE_MAX, 0   , 40000 },
+	{ "(?=(a*)*b)\\w"              , 'a', "!", SIZE_MAX, 0   , 40000 },
+};
+
+typedef struct
+{
+	char* pattern;
+	char* text; /* fed to a RegexStream in two pieces, split at every position */
+	size_t start; /* where the match should start, or SIZE_MAX if there shouldn't be one */
+	size_t length;
+} StreamTest;
+
+/* what a token eats can depend on the chars on both sides of it, which may come in another piece */
+StreamTest streamvector[] =
+{
+	{ "x[\\R]"                     , "ax\r\n"                , 1       , 2 },
+	{ "x[\\R]"                     , "ax\r\r\n"              , SIZE_MAX, 0 },
+	{ "[\\R]+$"                    , "a\r\n"                 , 1       , 2 },
+	{ "\\R$"                       , "a\r\n"                 , 1       , 2 },
+	{ "a\\b"                       , "ab a"                  , 3       , 1 },
+	{ "[\\b]b"                     , "xab bc"                , 3       , 2 },
+};
+
+#ifdef RE_USE_STATS
+typedef struct
+{
+	char* pattern;
+	char* text;
+	size_t counter; /* offset in re_stats of the counter that the search should count one in */
+} StatsTest;
+
+StatsTest statsvector[] =
+{
+	{ "\\d{3}"                     , "12"                    , offsetof(re_stats, tooshort)    },
+	{ "\\w+@example\\.com"         , "me@example.org"        , offsetof(re_stats, norequired)  },
+	{ "[0-9]+[xy]"                 , "12345"                 , offsetof(re_stats, dfarejects)  },
+	{ "abc"                        , "xxabc"                 , offsetof(re_stats, literal)     },
+	{ "\\d+$"                      , "abc 123"               , offsetof(re_stats, backward)    },
+	{ "a+b"                        , "aab"                   , offsetof(re_stats, nfa)         },
+	{ "\\d++5"                     , "12345"                 , offsetof(re_stats, backtracker) },
+};
+#endif
+
+/* patterns that are matched together as a RegexSet against every text in testvector */
+const char* setpatterns[] =
+{
+	"a+", "\\d\\w", "^(a)+a$", "[^\\d]+\\s", "\\Bing\\b", "(?=.*ghi)abc", "(?i:abcd)", "(?s:.)\\R", "b$",
+};
+/* number of times that the set matched by the tests goes through setpatterns */
+#define SETREPEATS 16
+
+/* storage of the compile cache, small enough that going through testvector evicts regexes all the time */
+RegexCacheEntry cacheentries[4];
+
+/* buffer for the regexes that don't fit in the Regex itself, with room for their automata */
+re_Token buf[256];
+/* buffer for serialized regexes */
+uint64_t serialbuf[(sizeof(Regex) + sizeof(buf)) / sizeof(uint64_t) + 8];
+
+/* a regex too large for the Regex itself, so that re_deserialize leaves its tokens and automata in the data, with a CGROUP, a GROUP, a CHARCLASS and every automaton */
+const char* corruptpattern = "(\\d+)-(?:[a-c]\\w)*\\s.aaaaaaaaaaaaaaaaaaaaaaa$";
+
+/* findinst: returns the index of the first instruction with op in the n instructions of program, or n if there is none */
+static size_t findinst(const NfaInst* program, size_t n, NfaOp op)
+{
+	size_t pc = 0;
+	while (pc < n && program[pc].op != op)
+		++pc;
+	return pc;
+}
+
+/* corrupt: damages corruptpattern, written by re_serialize with its Regex copied to regex and loaded from it into loaded, in the k-th way
+ * that re_deserialize has to turn down; returns what it did, or NULL if there are no more ways */
+static const char* corrupt(size_t k, Regex* regex, const Regex* loaded)
+{
+	re_Token* tokens = loaded->tokens;
+	switch (k) {
+		case 0:
+			regex->ntokens = 1000;
+			return "more tokens than there is data";
+		case 1:
+			regex->ntokens = SIZE_MAX;
+			return "so many tokens that their size wraps around";
+		case 2:
+			regex->ccli = 1000;
+			return "more class chars than there is data";
+		case 3:
+			regex->ccli = SIZE_MAX / sizeof(ClassChar) + 1;
+			return "so many class chars that their size wraps around";
+		case 4:
+			regex->ncharsets = MAXCHARSETS + 1;
+			return "more charsets than MAXCHARSETS";
+		case 5:
+			regex->nnfa = MAXNFA + 1;
+			return "more NFA instructions than MAXNFA";
+		case 6:
+			regex->ndfastates = MAXDFASTATES + 1;
+			return "more DFA states than MAXDFASTATES";
+		case 7:
+			regex->nbyteclasses = 0;
+			return "a DFA without byte classes";
+		case 8:
+			regex->nbyteclasses = CHARSETLEN * 8 - 1;
+			return "more DFA transitions than MAXDFATRANS";
+		case 9:
+			tokens[regex->ntokens].type = TOKEN_CHAR;
+			return "no END after the last token";
+		case 10:
+			tokens[3].charset = regex->ncharsets;
+			return "a token with a charset past ncharsets";
+		case 11:
+			tokens[1].meta = 100;
+			return "a metabsl that doesn't exist";
+		case 12:
+			tokens[5].ccl = regex->ccli;
+			return "a class that starts past ccli";
+		case 13:
+			loaded->cclbuf[tokens[5].ccl + 1].type = CCL_CHARRANGE;
+			return "a class without CCL_END";
+		case 14:
+			tokens[4].grouplen = 100;
+			return "a group that ends past the regex";
+		case 15:
+			tokens[7].grouplen = 2;
+			return "a group END that doesn't point back to its group";
+		case 16:
+			tokens[0].type = TOKEN_GROUP;
+			return "fewer capturing groups than ncaptures";
+		case 17:
+			loaded->nfa[findinst(loaded->nfa, loaded->nnfa, NFA_JMP)].x = loaded->nnfa;
+			return "an NFA jump past the program";
+		case 18:
+			loaded->rnfa[findinst(loaded->rnfa, loaded->nrnfa, NFA_SPLIT)].y = loaded->nrnfa;
+			return "a backward NFA split past the program";
+		case 19:
+			loaded->nfa[findinst(loaded->nfa, loaded->nnfa, NFA_SET)].arg = regex->ncharsets;
+			return "an NFA instruction with a charset past ncharsets";
+		case 20:
+			loaded->nfa[findinst(loaded->nfa, loaded->nnfa, NFA_SET)].op = NFA_ONE;
+			loaded->nfa[findinst(loaded->nfa, loaded->nnfa, NFA_ONE)].x = regex->ntokens;
+			return "an NFA instruction with a token past ntokens";
+		case 21:
+			loaded->nfa[loaded->nnfa - 1].op = NFA_CHAR;
+			return "an NFA program that runs off its end";
+		case 22:
+			loaded->byteclass['a'] = regex->nbyteclasses;
+			return "a byte class past nbyteclasses";
+		case 23:
+			loaded->dfa[0] = regex->ndfastates;
+			return "a DFA transition to a state past ndfastates";
+		case 24:
+			regex->requiredskip['a'] = 0;
+			return "a skip of 0 for the required string";
+		case 25:
+			regex->nrequired = regex->minlength + 1;
+			return "a required string longer than any match";
+		case 26:
+			memset(&regex->anchored, 2, 1);
+			return "a flag that is neither true nor false";
+		default:
+			return NULL;
+	}
+}
+
 
 int main()
 {
@@ -139,12 +314,78 @@ int main()
 		errno = 0;
 		Regex pattern;
 		re_compile(&pattern, testvector[i].pattern);
+		if (errno == ENOBUFS) {
+			errno = 0;
+			if (re_compilesize(testvector[i].pattern) > sizeof(buf)) {
+				fprintf(stderr, "[%zu/%zu]: pattern '%s' is too large for the test buffer.\n", i+1, ntests, testvector[i].pattern);
+				++nfailed;
+				continue;
+			}
+			re_compilebuf(&pattern, testvector[i].pattern, buf, sizeof(buf));
+		}
 		if (errno) {
 			fprintf(stderr, "[%zu/%zu]: pattern '%s' failed to compile.\n", i+1, ntests, testvector[i].pattern);
 			++nfailed;
 			continue;
 		}
 		re_match(pattern, testvector[i].text, NULL);
+		const int matcherrno = errno;
+
+		/* match the same text again, but without a null terminator after it */
+		char unterminated[64];
+		const size_t len = strlen(testvector[i].text);
+		memcpy(unterminated, testvector[i].text, len);
+		memset(unterminated+len, 'x', sizeof(unterminated)-len);
+		errno = 0;
+		re_matchn(&pattern, unterminated, len, NULL);
+		if (!errno != !matcherrno) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' gave different results for '%s' with and without a null terminator.\n", i+1, ntests, testvector[i].pattern, testvector[i].text);
+			++nfailed;
+			continue;
+		}
+		errno = matcherrno;
+
+		/* and again, fed one char at a time */
+		RegexStream stream;
+		re_stream_init(&stream, &pattern);
+		if (!errno) {
+			for (size_t j = 0; j < len; ++j)
+				re_stream_feed(&stream, &testvector[i].text[j], 1);
+			re_stream_end(&stream, NULL);
+			if (!errno != !matcherrno) {
+				fprintf(stderr, "[%zu/%zu]: pattern '%s' gave different results for '%s' when it was streamed.\n", i+1, ntests, testvector[i].pattern, testvector[i].text);
+				++nfailed;
+				continue;
+			}
+		}
+		errno = matcherrno;
+
+		/* and again, after a round trip through re_serialize */
+		const size_t serialsize = re_serialize(&pattern, serialbuf, sizeof(serialbuf));
+		Regex loaded;
+		if (errno || re_deserialize(&loaded, serialbuf, serialsize) != serialsize) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' couldn't be serialized and loaded again.\n", i+1, ntests, testvector[i].pattern);
+			++nfailed;
+			continue;
+		}
+		re_matchn(&loaded, testvector[i].text, len, NULL);
+		if (!errno != !matcherrno) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' gave different results for '%s' after it was serialized.\n", i+1, ntests, testvector[i].pattern, testvector[i].text);
+			++nfailed;
+			continue;
+		}
+		errno = matcherrno;
+
+		/* and again, in a batch */
+		const char* texts[2] = {testvector[i].text, testvector[i].text};
+		re_result results[2];
+		const size_t nmatched = re_match_batch(&pattern, texts, NULL, 2, results);
+		if (nmatched != (matcherrno ? 0 : 2) || results[0].start != results[1].start || results[0].length != results[1].length) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' gave different results for '%s' in a batch.\n", i+1, ntests, testvector[i].pattern, testvector[i].text);
+			++nfailed;
+			continue;
+		}
+		errno = matcherrno;
 
 		if (testvector[i].shouldsucceed && errno) {
 			/* failed where it should have succeeded */
@@ -163,7 +404,327 @@ int main()
 		}
 	}
 
-	printf("%zu/%zu tests succeeded.\n", ntests - nfailed, ntests);
+	const size_t ncapturetests = sizeof(capturevector) / sizeof(CaptureTest);
+	for (size_t i = 0; i < ncapturetests; ++i) {
+		Regex pattern;
+		re_compile(&pattern, capturevector[i].pattern);
+		re_span caps[4];
+		re_match_captures(&pattern, capturevector[i].text, strlen(capturevector[i].text), caps, 4);
+		const re_span* cap = &caps[capturevector[i].group];
+		if (errno || cap->start != capturevector[i].start || (cap->start != SIZE_MAX && cap->length != capturevector[i].length)) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' captured the wrong part of '%s' in group %zu.\n", ntests+i+1, ntests+ncapturetests, capturevector[i].pattern, capturevector[i].text, capturevector[i].group);
+			++nfailed;
+		}
+	}
+
+	/* more groups than the NFA fills slots for, which the backtracker captures instead */
+	Regex manygroups;
+	re_compile(&manygroups, "(a)(b)(c)(d)(e)(f)(g)(h)(j)+");
+	re_span manycaps[11];
+	re_match_captures(&manygroups, "_abcdefghjj", 11, manycaps, 11);
+	for (size_t n = 1; n < 11; ++n) {
+		/* the repeated group captures its last repetition, and there is no group 10 */
+		const size_t start = n < 9 ? n : n == 9 ? 10 : SIZE_MAX;
+		if (errno || manycaps[n].start != start || manycaps[n].length != (n < 10)) {
+			fprintf(stderr, "pattern '(a)(b)(c)(d)(e)(f)(g)(h)(j)+' captured the wrong part of '_abcdefghjj' in group %zu.\n", n);
+			++nfailed;
+		}
+	}
+
+	const size_t nglobaltests = sizeof(globalvector) / sizeof(GlobalTest);
+	for (size_t i = 0; i < nglobaltests; ++i) {
+		Regex pattern;
+		re_compile(&pattern, globalvector[i].pattern);
+		const size_t count = re_matchgp(&pattern, globalvector[i].text);
+		if (count != globalvector[i].count) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' matched '%s' %zu times instead of %zu.\n", ntests+ncapturetests+i+1, ntests+ncapturetests+nglobaltests, globalvector[i].pattern, globalvector[i].text, count, globalvector[i].count);
+			++nfailed;
+			continue;
+		}
+		/* counting in chunks has to give the same, however the text is split */
+		for (size_t n = 2; n <= 5; ++n) {
+			RegexChunk chunks[5];
+			const size_t nchunks = re_chunk_split(chunks, n, &pattern, globalvector[i].text, strlen(globalvector[i].text));
+			for (size_t c = 0; c < nchunks; ++c)
+				re_chunk_match(&chunks[c]);
+			const size_t chunkcount = re_chunk_join(chunks, nchunks);
+			if (chunkcount != count) {
+				fprintf(stderr, "[%zu/%zu]: pattern '%s' matched '%s' %zu times in %zu chunks instead of %zu.\n", ntests+ncapturetests+i+1, ntests+ncapturetests+nglobaltests, globalvector[i].pattern, globalvector[i].text, chunkcount, nchunks, count);
+				++nfailed;
+				break;
+			}
+		}
+	}
+
+	const size_t nbudgettests = sizeof(budgetvector) / sizeof(BudgetTest);
+	for (size_t i = 0; i < nbudgettests; ++i) {
+		Regex pattern;
+		re_compile(&pattern, budgetvector[i].pattern);
+		static size_t work[WORKLEN / sizeof(size_t)];
+		re_match_opts opts = {.maxsteps = budgetvector[i].maxsteps, .work = budgetvector[i].worklen ? work : NULL, .worklen = budgetvector[i].worklen};
+		re_matchopts(&pattern, budgetvector[i].text, strlen(budgetvector[i].text), NULL, &opts);
+		if (errno != budgetvector[i].error || (budgetvector[i].maxsteps && errno != ETIMEDOUT && opts.steps > budgetvector[i].maxsteps)) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' on '%s' with at most %zu steps set errno to %d after %zu steps.\n", ntests+ncapturetests+nglobaltests+i+1, ntests+ncapturetests+nglobaltests+nbudgettests, budgetvector[i].pattern, budgetvector[i].text, budgetvector[i].maxsteps, errno, opts.steps);
+			++nfailed;
+		}
+	}
+
+	const size_t ninfotests = sizeof(infovector) / sizeof(InfoTest);
+	for (size_t i = 0; i < ninfotests; ++i) {
+		Regex pattern;
+		re_compile(&pattern, infovector[i].pattern);
+		RegexInfo info;
+		re_info(&pattern, &info);
+		if (info.minlength != infovector[i].minlength || info.maxlength != infovector[i].maxlength || info.linear != infovector[i].linear) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' was found to match %zu to %zu chars (linear: %d).\n", ntests+ncapturetests+nglobaltests+nbudgettests+i+1, ntests+ncapturetests+nglobaltests+nbudgettests+ninfotests, infovector[i].pattern, info.minlength, info.maxlength, info.linear);
+			++nfailed;
+		}
+	}
+
+	const size_t nruntests = sizeof(runvector) / sizeof(RunTest);
+	for (size_t i = 0; i < nruntests; ++i) {
+		char text[RUNLEN + 2];
+		memset(text, runvector[i].c, RUNLEN);
+		strcpy(text + RUNLEN, runvector[i].end);
+		Regex pattern;
+		re_compile(&pattern, runvector[i].pattern);
+		re_match_opts opts = {.maxsteps = runvector[i].maxsteps};
+		size_t length = 0;
+		size_t start = re_matchopts(&pattern, text, strlen(text), &length, &opts);
+		const int error = errno;
+		if (error)
+			start = SIZE_MAX;
+		if (error == ETIMEDOUT || error == ENOBUFS || start != runvector[i].start || (!error && length != runvector[i].length)) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' matched %zu chars at %zu of a run of %zu '%c's, or took more than %zu steps.\n", ntests+ncapturetests+nglobaltests+nbudgettests+ninfotests+i+1, ntests+ncapturetests+nglobaltests+nbudgettests+ninfotests+nruntests, runvector[i].pattern, length, start, (size_t)RUNLEN, runvector[i].c, runvector[i].maxsteps);
+			++nfailed;
+		}
+	}
+	const size_t nstreamtests = sizeof(streamvector) / sizeof(StreamTest);
+	for (size_t i = 0; i < nstreamtests; ++i) {
+		Regex pattern;
+		re_compile(&pattern, streamvector[i].pattern);
+		const size_t len = strlen(streamvector[i].text);
+		for (size_t split = 0; split <= len; ++split) {
+			RegexStream stream;
+			re_stream_init(&stream, &pattern);
+			re_stream_feed(&stream, streamvector[i].text, split);
+			re_stream_feed(&stream, streamvector[i].text + split, len - split);
+			size_t length = 0;
+			size_t start = re_stream_end(&stream, &length);
+			if (errno)
+				start = SIZE_MAX;
+			if (start != streamvector[i].start || (!errno && length != streamvector[i].length)) {
+				fprintf(stderr, "[%zu/%zu]: pattern '%s' matched %zu chars at %zu of '%s' when it was streamed in pieces split at %zu.\n", ntests+ncapturetests+nglobaltests+nbudgettests+ninfotests+nruntests+i+1, ntests+ncapturetests+nglobaltests+nbudgettests+ninfotests+nruntests+nstreamtests, streamvector[i].pattern, length, start, streamvector[i].text, split);
+				++nfailed;
+				break;
+			}
+		}
+	}
+
+	/* QUANTIFIERMAX stands for no limit, so it can't be a count itself */
+	Regex toolarge;
+	re_compile(&toolarge, "a{65535}");
+	if (errno != EINVAL) {
+		fprintf(stderr, "a quantifier of QUANTIFIERMAX compiled.\n");
+		++nfailed;
+	}
+
+	size_t nstatstests = 0;
+#ifdef RE_USE_STATS
+	nstatstests = sizeof(statsvector) / sizeof(StatsTest);
+	for (size_t i = 0; i < nstatstests; ++i) {
+		/* the search should be counted in the stats of the regex, unless the call has its own */
+		Regex pattern;
+		re_compile(&pattern, statsvector[i].pattern);
+		re_stats stats = {.timed = true};
+		re_stats callstats = {0};
+		re_stats_attach(&pattern, &stats);
+		re_matchp(&pattern, statsvector[i].text, NULL);
+		re_match_opts opts = {.stats = &callstats};
+		re_matchopts(&pattern, statsvector[i].text, strlen(statsvector[i].text), NULL, &opts);
+		const size_t counted = *(size_t*)((char*)&stats + statsvector[i].counter);
+		if (stats.searches != 1 || counted != 1 || callstats.searches != 1 || callstats.steps != opts.steps) {
+			re_stats_print(&pattern, &stats);
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' on '%s' wasn't counted as expected.\n", i+1, nstatstests, statsvector[i].pattern, statsvector[i].text);
+			++nfailed;
+		}
+	}
+#endif
+
+	/* a regex from the cache should match like one compiled on its own, however often it was thrown out and compiled again */
+	RegexCache cache;
+	re_cache_init(&cache, cacheentries, sizeof(cacheentries) / sizeof(cacheentries[0]));
+	size_t ncachefits = 0;
+	for (size_t i = 0; i < ntests; ++i) {
+		Regex pattern;
+		re_compile(&pattern, testvector[i].pattern);
+		if (errno || strlen(testvector[i].pattern) >= MAXCACHEPATTERN)
+			continue;
+		++ncachefits;
+		const Regex* cached = re_cache_get(&cache, testvector[i].pattern);
+		if (!cached) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' couldn't be compiled into the cache.\n", i+1, ntests, testvector[i].pattern);
+			++nfailed;
+			continue;
+		}
+		size_t length, cachedlength;
+		const size_t start = re_matchp(&pattern, testvector[i].text, &length);
+		const int matcherrno = errno;
+		const size_t cachedstart = re_matchp(cached, testvector[i].text, &cachedlength);
+		if (errno != matcherrno || (!errno && (cachedstart != start || cachedlength != length))) {
+			fprintf(stderr, "[%zu/%zu]: pattern '%s' gave different results for '%s' from the cache.\n", i+1, ntests, testvector[i].pattern, testvector[i].text);
+			++nfailed;
+		}
+		re_cache_release(&cache, cached);
+	}
+	/* consecutive tests share their patterns, so some of them should have been hits */
+	if (cache.hits + cache.misses != ncachefits || !cache.hits || !cache.evictions) {
+		fprintf(stderr, "the cache counted %zu hits, %zu misses and %zu evictions for %zu patterns.\n", cache.hits, cache.misses, cache.evictions, ncachefits);
+		++nfailed;
+	}
+	/* the same pattern is shared, and regexes that are still in use aren't thrown out */
+	re_cache_init(&cache, cacheentries, 2);
+	const Regex* first = re_cache_get(&cache, "a+b");
+	const Regex* again = re_cache_get(&cache, "a+b");
+	const Regex* other = re_cache_get(&cache, "c");
+	if (!first || first != again || !other || re_cache_get(&cache, "d") || errno != ENOBUFS) {
+		fprintf(stderr, "the cache didn't share a pattern, or threw out a regex that was in use.\n");
+		++nfailed;
+	}
+	re_cache_release(&cache, first);
+	re_cache_release(&cache, again);
+	const Regex* reused = re_cache_get(&cache, "d");
+	if (!reused || reused != first || cache.evictions != 1) {
+		fprintf(stderr, "the cache didn't throw out a regex that was no longer in use.\n");
+		++nfailed;
+	}
+	re_cache_release(&cache, reused);
+	re_cache_release(&cache, other);
+	/* a regex released once too often, or that isn't from the cache, is turned down instead of being held for good */
+	re_cache_release(&cache, reused);
+	const int overreleased = errno;
+	re_cache_release(&cache, &cacheentries[2].regex);
+	const int unused = errno;
+	Regex stranger;
+	re_compile(&stranger, "c");
+	re_cache_release(&cache, &stranger);
+	if (overreleased != EINVAL || unused != EINVAL || errno != EINVAL || cacheentries[0].refs + cacheentries[1].refs != 0) {
+		fprintf(stderr, "the cache took back a regex that wasn't held.\n");
+		++nfailed;
+	}
+	if (re_cache_get(&cache, "(a") || errno != EINVAL) {
+		fprintf(stderr, "the cache returned a pattern that doesn't compile.\n");
+		++nfailed;
+	}
+
+	/* data that wasn't written by re_serialize shouldn't load */
+	Regex serialized;
+	re_compile(&serialized, "a+b");
+	const size_t serialsize = re_serialize(&serialized, serialbuf, sizeof(serialbuf));
+	((unsigned char*)serialbuf)[0] ^= 1;
+	re_deserialize(&serialized, serialbuf, serialsize);
+	if (errno != EINVAL) {
+		fprintf(stderr, "re_deserialize loaded data with the wrong header.\n");
+		++nfailed;
+	}
+	/* nor data written by a build with another format (the version follows the four bytes of the magic) */
+	re_serialize(&serialized, serialbuf, sizeof(serialbuf));
+	((unsigned char*)serialbuf)[4] ^= 1;
+	re_deserialize(&serialized, serialbuf, serialsize);
+	if (errno != EINVAL) {
+		fprintf(stderr, "re_deserialize loaded data with the wrong version.\n");
+		++nfailed;
+	}
+	/* nor data that was damaged in a way that would make matching go outside of it */
+	Regex corruptregex, corruptloaded;
+	re_compilebuf(&corruptregex, corruptpattern, buf, sizeof(buf));
+	const char* what;
+	for (size_t k = 0; ; ++k) {
+		const size_t corruptsize = re_serialize(&corruptregex, serialbuf, sizeof(serialbuf));
+		re_deserialize(&corruptloaded, serialbuf, corruptsize);
+		if (errno || corruptloaded.tokens == corruptloaded.inlinetokens || !corruptloaded.ndfastates || !corruptloaded.nrnfa) {
+			fprintf(stderr, "'%s' didn't load with its tokens and all its automata left in the data.\n", corruptpattern);
+			++nfailed;
+			break;
+		}
+		/* the Regex is right before its tokens */
+		unsigned char* image = (unsigned char*)corruptloaded.tokens - sizeof(Regex);
+		Regex regex;
+		memcpy(&regex, image, sizeof(regex));
+		if (!(what = corrupt(k, &regex, &corruptloaded)))
+			break;
+		memcpy(image, &regex, sizeof(regex));
+		Regex damaged;
+		re_deserialize(&damaged, serialbuf, corruptsize);
+		if (errno != EINVAL) {
+			fprintf(stderr, "re_deserialize loaded data with %s.\n", what);
+			++nfailed;
+		}
+	}
+
+	/* automata too large for the Regex itself are left out, but kept in a buffer that re_compilesize made room for */
+	Regex repeated, repeatedbuf;
+	RegexInfo repeatedinfo, repeatedbufinfo;
+	re_compile(&repeated, "a{90}");
+	re_info(&repeated, &repeatedinfo);
+	const size_t repeatedsize = re_compilesize("a{90}");
+	re_compilebuf(&repeatedbuf, "a{90}", buf, repeatedsize < sizeof(buf) ? repeatedsize : sizeof(buf));
+	re_info(&repeatedbuf, &repeatedbufinfo);
+	char as[100];
+	memset(as, 'a', sizeof(as) - 1);
+	as[sizeof(as) - 1] = '\0';
+	size_t repeatedlength = 0, repeatedbuflength = 0;
+	re_matchp(&repeated, as, &repeatedlength);
+	re_matchp(&repeatedbuf, as, &repeatedbuflength);
+	if (repeatedsize > sizeof(buf) || repeatedinfo.linear || !repeatedbufinfo.linear || repeatedlength != 90 || repeatedbuflength != 90) {
+		fprintf(stderr, "the automata of 'a{90}' weren't left out of the Regex itself and kept in its buffer.\n");
+		++nfailed;
+	}
+
+	/* a regex with more tokens than MAXNFATOKENS has no automata, and re_compilesize makes room for its tokens only */
+	static char manytokens[MAXNFATOKENS + 2];
+	memset(manytokens, 'a', sizeof(manytokens) - 1);
+	static re_Token manytokensbuf[MAXNFATOKENS + 8];
+	Regex manytokensregex;
+	RegexInfo manytokensinfo;
+	const size_t manytokenssize = re_compilesize(manytokens);
+	re_compilebuf(&manytokensregex, manytokens, manytokensbuf, sizeof(manytokensbuf));
+	re_info(&manytokensregex, &manytokensinfo);
+	size_t manytokenslength = 0;
+	re_matchp(&manytokensregex, manytokens, &manytokenslength);
+	if (manytokenssize != (MAXNFATOKENS + 2) * sizeof(re_Token) || manytokensinfo.linear || manytokenslength != MAXNFATOKENS + 1) {
+		fprintf(stderr, "the regex of %d 'a's was given automata or didn't match itself.\n", MAXNFATOKENS + 1);
+		++nfailed;
+	}
+
+	/* the set repeats setpatterns, so that it is matched in more than one block of regexes */
+	const size_t nsetpatterns = SETREPEATS * sizeof(setpatterns) / sizeof(setpatterns[0]);
+	const char* setall[SETREPEATS * sizeof(setpatterns) / sizeof(setpatterns[0])];
+	for (size_t n = 0; n < nsetpatterns; ++n)
+		setall[n] = setpatterns[n % (sizeof(setpatterns) / sizeof(setpatterns[0]))];
+	Regex setregexes[SETREPEATS * sizeof(setpatterns) / sizeof(setpatterns[0])];
+	RegexSet set;
+	re_set_compile(&set, setregexes, setall, nsetpatterns);
+	for (size_t i = 0; i < ntests; ++i) {
+		/* the set should agree with matching each regex on its own */
+		unsigned char matched[(SETREPEATS * sizeof(setpatterns) / sizeof(setpatterns[0]) + 7) / 8];
+		re_span spans[SETREPEATS * sizeof(setpatterns) / sizeof(setpatterns[0])];
+		const size_t len = strlen(testvector[i].text);
+		re_set_match(&set, testvector[i].text, len, matched);
+		re_set_find(&set, testvector[i].text, len, spans);
+		for (size_t n = 0; n < nsetpatterns; ++n) {
+			size_t length = 0;
+			const size_t start = re_matchn(&setregexes[n], testvector[i].text, len, &length);
+			const bool found = !errno;
+			if (found != ((matched[n / 8] >> (n % 8)) & 1) || (found ? spans[n].start != start || spans[n].length != length : spans[n].start != SIZE_MAX)) {
+				fprintf(stderr, "[%zu/%zu]: set pattern %zu, '%s', gave a different result for '%s' than on its own.\n", i+1, ntests, n, setall[n], testvector[i].text);
+				++nfailed;
+			}
+		}
+	}
+
+	const size_t ntotal = ntests + ncapturetests + nglobaltests + nbudgettests + ninfotests + nruntests + nstreamtests + nstatstests;
+	printf("%zu/%zu tests succeeded.\n", ntotal - nfailed, ntotal);
 
 	return 0;
 }
@@ -0,0 +1,122 @@
+/*
+ * This program checks that re.hpp gives the same results as re_matchn, for the patterns of tests/fixed.c.
+ *
+ * Every pattern is matched against every text of the fixed tests, and against every suffix of them. Then a few
+ * patterns that make the generated matcher backtrack a lot are matched against long texts, which only finishes if
+ * it gives up and leaves them to re_matchn.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "re.hpp"
+
+static const char* texts[] =
+{
+#define TEST(shouldsucceed, pattern, text) text,
+#include "testvector.h"
+#undef TEST
+};
+
+static const std::size_t ntests = sizeof(texts) / sizeof(*texts);
+/* number of checks with slow patterns */
+static const std::size_t nslowtests = 5;
+static std::size_t nfailed = 0;
+static std::size_t nspecialised = 0;
+
+/* check: runs the test i, for Pattern and its own text, and counts it in nfailed if it fails */
+template <re::fixed_string Pattern>
+static void check(std::size_t i, bool shouldsucceed, const char* text)
+{
+	const char* pattern = Pattern.chars;
+	if (re::static_regex<Pattern>::specialised)
+		++nspecialised;
+
+	static re_Token buf[256];
+	Regex regex;
+	errno = 0;
+	re_compilebuf(&regex, pattern, buf, sizeof(buf));
+	if (errno) {
+		std::fprintf(stderr, "[%zu/%zu]: pattern '%s' failed to compile.\n", i+1, ntests, pattern);
+		++nfailed;
+		return;
+	}
+
+	for (std::size_t t = 0; t < ntests; ++t) {
+		const std::size_t len = std::strlen(texts[t]);
+		for (std::size_t k = 0; k <= len; ++k) {
+			std::size_t length = 0;
+			errno = 0;
+			const std::size_t start = re_matchn(&regex, texts[t] + k, len - k, &length);
+			const int error = errno;
+			std::size_t hpplength = 0;
+			errno = 0;
+			const std::size_t hppstart = re::match<Pattern>(texts[t] + k, len - k, &hpplength);
+			if (errno != error || hppstart != start || (!error && hpplength != length)) {
+				std::fprintf(stderr, "[%zu/%zu]: pattern '%s' gave %s (%zu, %zu) for '%s' in re.hpp, but %s (%zu, %zu) in re.c.\n",
+				             i+1, ntests, pattern, errno ? "no match" : "a match", hppstart, hpplength, texts[t] + k,
+				             error ? "no match" : "a match", start, length);
+				++nfailed;
+				return;
+			}
+		}
+	}
+
+	errno = 0;
+	re::match<Pattern>(text);
+	if (shouldsucceed && errno) {
+		std::fprintf(stderr, "[%zu/%zu]: pattern '%s' didn't match '%s' as expected.\n", i+1, ntests, pattern, text);
+		++nfailed;
+	} else if (!shouldsucceed && !errno) {
+		std::fprintf(stderr, "[%zu/%zu]: pattern '%s' matched '%s' unexpectedly.\n", i+1, ntests, pattern, text);
+		++nfailed;
+	}
+}
+
+/* checkslow: matches Pattern against text, which is len chars long, and counts it in nfailed if the result isn't re_matchn's */
+template <re::fixed_string Pattern>
+static void checkslow(std::size_t i, const char* text, std::size_t len)
+{
+	const char* pattern = Pattern.chars;
+	if (re::static_regex<Pattern>::specialised)
+		++nspecialised;
+
+	static re_Token buf[256];
+	Regex regex;
+	re_compilebuf(&regex, pattern, buf, sizeof(buf));
+	std::size_t length = 0;
+	errno = 0;
+	const std::size_t start = re_matchn(&regex, text, len, &length);
+	const int error = errno;
+	std::size_t hpplength = 0;
+	errno = 0;
+	const std::size_t hppstart = re::match<Pattern>(text, len, &hpplength);
+	if (errno != error || hppstart != start || (!error && hpplength != length)) {
+		std::fprintf(stderr, "[%zu/%zu]: pattern '%s' gave %s (%zu, %zu) in re.hpp, but %s (%zu, %zu) in re.c.\n",
+		             i+1, ntests + nslowtests, pattern, errno ? "no match" : "a match", hppstart, hpplength,
+		             error ? "no match" : "a match", start, length);
+		++nfailed;
+	}
+}
+
+int main()
+{
+	std::size_t i = 0;
+#define TEST(shouldsucceed, pattern, text) check<pattern>(i++, shouldsucceed, text);
+#include "testvector.h"
+#undef TEST
+
+	/* these take time polynomial in the length of the text (and exponential in the number of quantifiers) to backtrack through */
+	static char as[5000];
+	std::memset(as, 'a', sizeof(as));
+	checkslow<"\\w*\\w*\\w*\\w*\\w*!">(i++, as, sizeof(as));
+	checkslow<"\\w*?\\w*?\\w*?\\w*?\\w*?!">(i++, as, sizeof(as));
+	checkslow<"a*?a*?a*?a*?a*?$">(i++, as, sizeof(as));
+	checkslow<"\\w{0,100}\\w*\\d">(i++, as, sizeof(as));
+	checkslow<"^[^b]*[^c]*[^d]*b">(i++, as, sizeof(as));
+
+	std::printf("%zu/%zu tests succeeded, %zu of them with a specialised matcher.\n", ntests + nslowtests - nfailed, ntests + nslowtests, nspecialised);
+
+	return 0;
+}
@@ -0,0 +1,663 @@
+/*
+ * A differential fuzzer: matches patterns against texts through every engine and entry point, and checks that they
+ * agree and that none of them takes too long.
+ *
+ * Usage: tests/fuzz [-seed N] [-patterns N] [-steps N] [-ms N] [-slow] [FILE...]
+ *
+ * Without files, N random patterns are generated, many of them with nested quantifiers, and each is matched against
+ * texts made to be hard for it: runs of one char, random texts over the chars of the pattern, near misses (a text
+ * that matches with the last char of its match changed or cut off) and matches pumped up to a few thousand chars.
+ * Each FILE holds one input, a pattern optionally followed by a NUL and a text; without a text, the texts are made
+ * up as for a random pattern. Build with -DRE_FUZZ_LIBFUZZER for a libFuzzer target (clang -fsanitize=fuzzer) that
+ * takes the same inputs; AFL can run the normal build with @@ as FILE.
+ *
+ * For every text, re_matchn is compared with re_match_captures (which runs the NFA with capture slots instead of the
+ * backward NFA and the DFA), a RegexStream (which runs the NFA a piece at a time), re_match_batch, a serialized copy, a
+ * RegexSet, and the number of matches of re_find_iter with re_matchgn and the chunked count. Build with
+ * -DRE_FUZZ_PCRE2 and -lpcre2-8 to also compare with PCRE2, for the patterns that mean the same to both. A match
+ * is too slow if it takes more than -steps steps per char of text (10000 by default) or -ms milliseconds (100); the
+ * throughput of all of them and the slowest one are reported. Only the first match is timed, as nothing but
+ * re_matchopts bounds the backtracker, so a pattern that is slow only from the starts after its first match (such as
+ * one with a lookbehind without a limit on its length) can make the counts of all matches take much longer; for those
+ * lookbehinds, the matches are only counted in texts of fewer than 256 chars.
+ *
+ * A pattern with a lookbehind without a limit on its length takes the backtracker time quadratic in the length of the
+ * text (see the README for why), so its texts that are too slow are reported, but known to be and not counted as
+ * failures; the others for the default seed all pass. A text that the backtracker runs out of room for (a group
+ * repeated for hundreds of chars, with a choice left at each repetition) is reported too, without failing, as the other
+ * ways of matching it can have more room or need less. tests/slow holds inputs that are known to be too slow; with
+ * -slow, each FILE is expected to be, and one that no longer is fails instead, so that it can be moved out of the
+ * corpus once the backtracker handles it.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef RE_FUZZ_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
+
+#include "re.h"
+
+/* longest text that is made up for a pattern */
+#define MAXTEXT 4096
+/* longest pattern that is made up */
+#define MAXPATTERN 256
+/* number of texts that are made up for each pattern */
+#define NTEXTS 24
+
+static unsigned long seed = 1;
+static size_t stepsperchar = 10000; /* -steps */
+static double maxseconds = 0.1; /* -ms */
+static bool expectslow = false; /* -slow */
+
+static size_t npatterns = 0;
+static size_t ntexts = 0;
+static size_t nwrong = 0; /* texts that an engine got a different result for */
+static size_t nslow = 0; /* texts that took too long */
+static size_t nknown = 0; /* of those, the ones of patterns that the backtracker is known to be slow for */
+static size_t nfull = 0; /* texts that the backtracker ran out of room for, which isn't a failure */
+static double seconds = 0; /* spent in the matches that are timed, to work out the throughput */
+static size_t chars = 0; /* matched by them */
+static double slowest = 0; /* most seconds per char of a match of a long text */
+static char slowestpattern[MAXPATTERN];
+static size_t slowestlen = 0;
+
+/* rnd: returns a pseudo random number below n, the same on every run with the same seed */
+static size_t rnd(size_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+#ifndef RE_FUZZ_LIBFUZZER
+/* pick: returns one of the n strings in choices */
+static const char* pick(const char* const* choices, size_t n)
+{
+	return choices[rnd(n)];
+}
+
+/* append: appends s to the pattern of size bytes in out, if there is room */
+static void append(char* out, size_t size, const char* s)
+{
+	const size_t n = strlen(out);
+	if (n + strlen(s) < size)
+		strcpy(out + n, s);
+}
+
+/* genpattern: appends a random pattern to out, with groups nested up to depth more levels */
+static void genpattern(char* out, size_t size, int depth)
+{
+	static const char* const atoms[] = {
+		"a", "b", "c", "A", "x", "1", "_", " ", "-", ".", "\\.", "\\d", "\\w", "\\s", "\\D", "\\W", "\\S", "\\b", "\\B",
+		"\\R", "\\n", "[ab]", "[^a]", "[a-c]", "[\\d_]", "[^\\s]", "[xy1-3]", "^", "$", "(?i:a)", "(?s:.)", "ab", "abc",
+		"error", "\\d\\d", "a\\sb",
+	};
+	static const char* const quantifiers[] = {
+		"", "", "", "", "", "*", "+", "?", "{2}", "{1,3}", "{0,2}", "{2,}", "*?", "+?", "??", "{1,2}?", "*+", "++", "?+",
+	};
+	static const char* const opens[] = { "(", "(?:", "(?i:", "(?s:", "(?=", "(?!", "(?<=", "(?<!" };
+	static const char* const groupquantifiers[] = { "", "", "*", "+", "?", "{2}", "{0,3}", "*?", "+?", "{1,2}+" };
+	const size_t n = rnd(5) + 1;
+	for (size_t k = 0; k < n; ++k) {
+		if (depth > 0 && rnd(5) == 0) {
+			/* a group, which is quantified itself more often than not, so that quantifiers get nested */
+			const size_t open = rnd(sizeof(opens) / sizeof(opens[0]));
+			append(out, size, opens[open]);
+			genpattern(out, size, depth - 1);
+			append(out, size, ")");
+			if (open < 4)
+				append(out, size, pick(groupquantifiers, sizeof(groupquantifiers) / sizeof(groupquantifiers[0])));
+		} else {
+			append(out, size, pick(atoms, sizeof(atoms) / sizeof(atoms[0])));
+			append(out, size, pick(quantifiers, sizeof(quantifiers) / sizeof(quantifiers[0])));
+		}
+	}
+}
+#endif
+
+/* alphabet: stores in chars the chars that the pattern is most likely to care about, returns how many there are */
+static size_t alphabet(const char* pattern, char* chars)
+{
+	static const char extra[] = "a1 _\n.-";
+	bool seen[256] = { false };
+	size_t n = 0;
+	for (const char* p = pattern; *p; ++p) {
+		/* the chars standing for classes are less useful than members of them */
+		char c = *p;
+		if (p > pattern && p[-1] == '\\') {
+			switch (c) {
+				case 'd': c = '7'; break;
+				case 'w': c = 'w'; break;
+				case 's': c = '\t'; break;
+				case 'R': c = '\r'; break;
+				case 'n': c = '\n'; break;
+				default: break;
+			}
+		}
+		if (!seen[(unsigned char)c]) {
+			seen[(unsigned char)c] = true;
+			chars[n++] = c;
+		}
+	}
+	for (const char* p = extra; *p; ++p) {
+		if (!seen[(unsigned char)*p]) {
+			seen[(unsigned char)*p] = true;
+			chars[n++] = *p;
+		}
+	}
+	return n;
+}
+
+/* gentext: makes up the kth text for pattern in text, returns its length */
+static size_t gentext(const Regex* regex, const char* pattern, size_t k, char* text)
+{
+	char chars[256 + 8];
+	const size_t nchars = alphabet(pattern, chars);
+	size_t len = 0;
+	if (k < 4) {
+		/* a long run of one char, maybe with another at the end */
+		const char c = chars[rnd(nchars)];
+		len = rnd(MAXTEXT / 2) + 256;
+		memset(text, c, len);
+		if (k & 1)
+			text[len-1] = chars[rnd(nchars)];
+		return len;
+	}
+	/* a short random text over the chars of the pattern */
+	len = rnd(24);
+	for (size_t i = 0; i < len; ++i)
+		text[i] = chars[rnd(nchars)];
+	if (k < 12)
+		return len;
+
+	/* the rest start with a match, if one of a few tries finds one */
+	size_t start = 0;
+	size_t length = 0;
+	for (size_t tries = 0; tries < 16; ++tries) {
+		start = re_matchn(regex, text, len, &length);
+		if (!errno && length)
+			break;
+		len = rnd(24);
+		for (size_t i = 0; i < len; ++i)
+			text[i] = chars[rnd(nchars)];
+	}
+	if (errno || !length)
+		return len;
+	char match[24];
+	memcpy(match, text + start, length);
+	switch (k % 4) {
+		case 0:
+			/* a near miss: the match with its last char changed */
+			memcpy(text, match, length);
+			text[length-1] = chars[rnd(nchars)];
+			return length;
+		case 1:
+			/* a near miss: the match with its last char cut off, after a long run of the rest */
+			len = 0;
+			while (length > 1 && len + length < MAXTEXT / 2) {
+				memcpy(text + len, match, length - 1);
+				len += length - 1;
+			}
+			return len;
+		case 2:
+			/* the match pumped up, ending in a char that may not fit */
+			len = 0;
+			while (len + length < MAXTEXT) {
+				memcpy(text + len, match, length);
+				len += length;
+			}
+			text[len-1] = chars[rnd(nchars)];
+			return len;
+		default:
+			/* the first char of the match over and over, then the match */
+			len = rnd(MAXTEXT - 2 * length) + 1;
+			memset(text, match[0], len);
+			memcpy(text + len, match, length);
+			return len + length;
+	}
+}
+
+/* printtext: prints text to stderr with its special chars escaped, and only the start and end if it is long */
+static void printtext(const char* text, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		if (len > 80 && i == 40) {
+			fprintf(stderr, "...(%zu chars)...", len - 80);
+			i = len - 40;
+		}
+		const unsigned char c = (unsigned char)text[i];
+		if (c == '\n')
+			fprintf(stderr, "\\n");
+		else if (c == '\r')
+			fprintf(stderr, "\\r");
+		else if (c == '\t')
+			fprintf(stderr, "\\t");
+		else if (c < ' ' || c >= 0x7f)
+			fprintf(stderr, "\\x%02x", c);
+		else
+			fprintf(stderr, "%c", c);
+	}
+}
+
+/* fail: reports that checking pattern against text failed, for the reason given */
+static void fail(const char* pattern, const char* text, size_t len, const char* reason, size_t start, size_t length, size_t otherstart, size_t otherlength)
+{
+	fprintf(stderr, "pattern '%s' on '", pattern);
+	printtext(text, len);
+	fprintf(stderr, "': %s (%zu, %zu) instead of (%zu, %zu).\n", reason, otherstart, otherlength, start, length);
+	++nwrong;
+}
+
+#ifdef RE_FUZZ_PCRE2
+/* pcrecompatible: returns whether pattern means the same to PCRE2 as to re_compile */
+static bool pcrecompatible(const char* pattern)
+{
+	bool inclass = false;
+	bool repeatable = false; /* whether a quantifier may come next */
+	for (const char* p = pattern; *p; ++p) {
+		if (inclass) {
+			if (*p == '\\') {
+				/* \b is a backspace in a PCRE2 class, and the letters other than these are escapes of their own */
+				if (!p[1] || !strchr("dDwWsS.-^]\\[", p[1]))
+					return false;
+				++p;
+			} else if (*p == '[' && p[1] == ':') {
+				return false;
+			} else if (*p == ']') {
+				inclass = false;
+				repeatable = true;
+			}
+			continue;
+		}
+		switch (*p) {
+			case '\\':
+				/* \R and the other letters have more meanings in PCRE2 */
+				if (!p[1] || (!strchr("dDwWsSbB", p[1]) && ((p[1] >= 'a' && p[1] <= 'z') || (p[1] >= 'A' && p[1] <= 'Z') || (p[1] >= '0' && p[1] <= '9'))))
+					return false;
+				++p;
+				repeatable = true;
+				break;
+			case '[':
+				inclass = true;
+				/* a ] right after the [ is a member in PCRE2 */
+				if (p[1] == ']' || (p[1] == '^' && p[2] == ']'))
+					return false;
+				if (p[1] == '^')
+					++p;
+				break;
+			case '(':
+				if (p[1] == '?') {
+					/* the groups with modifiers and the lookarounds that PCRE2 has too */
+					const char* q = p + 2;
+					if (*q == '<' && (q[1] == '=' || q[1] == '!')) {
+						++q;
+					} else {
+						while (*q == 'i' || *q == 's' || *q == '-')
+							++q;
+						if (*q != ':' && (q != p + 2 || (*q != '=' && *q != '!')))
+							return false;
+					}
+					p = q;
+				}
+				repeatable = false;
+				break;
+			case ')':
+				repeatable = true;
+				break;
+			case '|':
+				/* a char here, but alternation there */
+				return false;
+			case '*': /* FALLTHROUGH */
+			case '+':
+			case '?':
+			case '{':
+				if (!repeatable)
+					/* a char here, but an error or a quantifier of a quantifier there */
+					return false;
+				if (*p == '{') {
+					/* only {n}, {n,} and {n,m}, without the forms that only newer PCRE2 versions take */
+					char* end;
+					const unsigned long min = strtoul(p + 1, &end, 10);
+					if (end == p + 1 || min >= QUANTIFIERMAX)
+						return false;
+					if (*end == ',' && end[1] != '}') {
+						const char* maxstart = end + 1;
+						const unsigned long max = strtoul(maxstart, &end, 10);
+						if (end == maxstart || max >= QUANTIFIERMAX || max < min)
+							return false;
+					} else if (*end == ',') {
+						++end;
+					}
+					if (*end != '}')
+						return false;
+					p = end;
+				}
+				/* a lazy or possessive marker, but not both */
+				if (p[1] == '?' || p[1] == '+')
+					++p;
+				repeatable = false;
+				break;
+			default:
+				repeatable = true;
+				break;
+		}
+	}
+	return !inclass;
+}
+#endif
+
+/* skipclass: returns where the class that starts at the [ at p ends: at its ], or at the NUL if it isn't closed */
+static const char* skipclass(const char* p)
+{
+	for (++p; *p && *p != ']'; ++p) {
+		if (*p == '\\' && p[1])
+			++p;
+	}
+	return p;
+}
+
+/* unboundedlookbehind: returns whether pattern has a lookbehind without a limit on the length of what it matches */
+static bool unboundedlookbehind(const char* pattern)
+{
+	for (const char* p = pattern; *p; ++p) {
+		if (*p == '\\' && p[1]) {
+			++p;
+		} else if (*p == '[') {
+			p = skipclass(p);
+			if (!*p)
+				break;
+		} else if (*p == '(' && p[1] == '?' && p[2] == '<' && (p[3] == '=' || p[3] == '!')) {
+			/* the tokens of the lookbehind, up to the ) that closes it, are a regex of their own */
+			const char* const body = p + 4;
+			const char* q = body;
+			for (size_t depth = 1; *q; ++q) {
+				if (*q == '\\' && q[1]) {
+					++q;
+				} else if (*q == '[') {
+					q = skipclass(q);
+					if (!*q)
+						break;
+				} else if (*q == '(') {
+					++depth;
+				} else if (*q == ')' && !--depth) {
+					break;
+				}
+			}
+			if (!*q)
+				break;
+			static char inner[MAXPATTERN];
+			static re_Token buf[1024];
+			memcpy(inner, body, q - body);
+			inner[q - body] = '\0';
+			Regex regex;
+			errno = 0;
+			re_compilebuf(&regex, inner, buf, sizeof(buf));
+			if (errno)
+				continue;
+			RegexInfo info;
+			re_info(&regex, &info);
+			if (info.maxlength == SIZE_MAX)
+				return true;
+		}
+	}
+	return false;
+}
+
+/* count: returns the number of matches that re_find_iter finds */
+static size_t count(const Regex* regex, const char* text, size_t len)
+{
+	RegexIter iter;
+	re_find_init(&iter, regex, text, len);
+	size_t n = 0;
+	while (re_find_iter(&iter, NULL, 0))
+		++n;
+	return n;
+}
+
+/* check: matches regex, compiled from pattern, against text in every way there is, and reports where they don't agree */
+static void check(const Regex* regex, const char* pattern, const char* text, size_t len)
+{
+	++ntexts;
+
+	/* the timed match comes first, so that a text that is too slow isn't matched in all the other ways too */
+	re_match_opts opts = {.maxsteps = stepsperchar * (len + 1)};
+	const clock_t startclock = clock();
+	opts.deadline = startclock + (clock_t)(maxseconds * CLOCKS_PER_SEC) + 1;
+	size_t length = 0;
+	size_t start = re_matchopts(regex, text, len, &length, &opts);
+	const double taken = (double)(clock() - startclock) / CLOCKS_PER_SEC;
+	const int error = errno;
+	const bool known = unboundedlookbehind(pattern);
+	if (error == ETIMEDOUT) {
+		fprintf(stderr, "pattern '%s' on '", pattern);
+		printtext(text, len);
+		fprintf(stderr, "': gave up after %zu steps and %.3f s%s.\n", opts.steps, taken, known ? ", as is known for a lookbehind without a limit on its length" : "");
+		++nslow;
+		nknown += known;
+		return;
+	}
+	if (error == ENOBUFS) {
+		/* the other ways of matching can have more room or need less, so they have nothing to agree on */
+		fprintf(stderr, "pattern '%s' on '", pattern);
+		printtext(text, len);
+		fprintf(stderr, "': ran out of room for the backtracker's choices after %zu steps.\n", opts.steps);
+		++nfull;
+		return;
+	}
+	const bool found = !error;
+	if (!found)
+		start = length = SIZE_MAX;
+	seconds += taken;
+	chars += len;
+	if (len >= 256 && taken / len > slowest) {
+		slowest = taken / len;
+		slowestlen = len;
+		strcpy(slowestpattern, pattern);
+	}
+
+	size_t otherlength = 0;
+	size_t otherstart = re_matchn(regex, text, len, &otherlength);
+	if (errno)
+		otherstart = otherlength = SIZE_MAX;
+	if (otherstart != start || otherlength != length)
+		fail(pattern, text, len, "re_matchn found", start, length, otherstart, otherlength);
+
+	re_span caps[4];
+	re_match_captures(regex, text, len, caps, 4);
+	if (errno)
+		caps[0].start = caps[0].length = SIZE_MAX;
+	if (caps[0].start != start || caps[0].length != length)
+		fail(pattern, text, len, "re_match_captures found", start, length, caps[0].start, caps[0].length);
+
+	const char* texts[1] = { text };
+	re_result result;
+	re_match_batch(regex, texts, &len, 1, &result);
+	if (result.start != start || (found && result.length != length))
+		fail(pattern, text, len, "re_match_batch found", start, length, result.start, result.length);
+
+	static uint64_t serialbuf[(sizeof(Regex) + 4096 + MAXAUTOMATALEN) / sizeof(uint64_t)];
+	Regex loaded;
+	re_serialize(regex, serialbuf, sizeof(serialbuf));
+	if (!errno) {
+		re_deserialize(&loaded, serialbuf, sizeof(serialbuf));
+		otherstart = re_matchn(&loaded, text, len, &otherlength);
+		if (errno)
+			otherstart = otherlength = SIZE_MAX;
+		if (otherstart != start || otherlength != length)
+			fail(pattern, text, len, "a serialized copy found", start, length, otherstart, otherlength);
+	}
+
+	RegexSet set = { (Regex*)regex, 1 };
+	re_span span;
+	re_set_find(&set, text, len, &span);
+	if (span.start != start || (found && span.length != length))
+		fail(pattern, text, len, "a RegexSet found", start, length, span.start, span.length);
+
+	RegexStream stream;
+	re_stream_init(&stream, regex);
+	if (!errno) {
+		/* fed in pieces of random sizes, so that the boundaries fall everywhere */
+		for (size_t i = 0; i < len;) {
+			const size_t n = rnd(len - i < 64 ? len - i : 64) + 1;
+			if (re_stream_feed(&stream, text + i, n))
+				break;
+			i += n;
+		}
+		otherstart = re_stream_end(&stream, &otherlength);
+		if (errno)
+			otherstart = otherlength = SIZE_MAX;
+		if (otherstart != start || otherlength != length)
+			fail(pattern, text, len, "a RegexStream found", start, length, otherstart, otherlength);
+	}
+
+	/* such a lookbehind tries every char before each match, which on a long text with many of them can take much longer than the first */
+	if (!known || len < 256) {
+		const size_t matches = count(regex, text, len);
+		const size_t globalmatches = re_matchgn(regex, text, len);
+		RegexChunk chunks[3];
+		const size_t nchunks = re_chunk_split(chunks, 3, regex, text, len);
+		for (size_t c = 0; c < nchunks; ++c)
+			re_chunk_match(&chunks[c]);
+		const size_t chunkmatches = re_chunk_join(chunks, nchunks);
+		if (globalmatches != matches || chunkmatches != matches || (matches != 0) != found)
+			fail(pattern, text, len, "re_matchgn and the chunks counted", matches, 0, globalmatches, chunkmatches);
+	}
+
+#ifdef RE_FUZZ_PCRE2
+	static char pcrepattern[MAXPATTERN] = "";
+	static pcre2_code* pcreregex = NULL;
+	if (!pcreregex || strcmp(pcrepattern, pattern) != 0) {
+		/* compiled once for all the texts of a pattern, which the generated ones all keep in the same buffer */
+		pcre2_code_free(pcreregex);
+		pcreregex = NULL;
+		strcpy(pcrepattern, pattern);
+		int errorcode;
+		PCRE2_SIZE erroroffset;
+		if (pcrecompatible(pattern))
+			pcreregex = pcre2_compile((PCRE2_SPTR8)pattern, PCRE2_ZERO_TERMINATED, PCRE2_DOLLAR_ENDONLY, &errorcode, &erroroffset, NULL);
+	}
+	if (pcreregex) {
+		pcre2_match_data* md = pcre2_match_data_create(1, NULL);
+		const int rc = pcre2_match(pcreregex, (PCRE2_SPTR8)text, len, 0, 0, md, NULL);
+		if (rc >= 0 || rc == PCRE2_ERROR_NOMATCH) {
+			const PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(md);
+			otherstart = rc >= 0 ? ovector[0] : SIZE_MAX;
+			otherlength = rc >= 0 ? ovector[1] - ovector[0] : SIZE_MAX;
+			if (otherstart != start || otherlength != length)
+				fail(pattern, text, len, "PCRE2 found", start, length, otherstart, otherlength);
+		}
+		pcre2_match_data_free(md);
+	}
+#endif
+}
+
+/* fuzz: compiles pattern and checks it against the given text, or against texts made up for it if text is NULL */
+static void fuzz(const char* pattern, const char* text, size_t len)
+{
+	static re_Token buf[1024];
+	Regex regex;
+	errno = 0;
+	re_compilebuf(&regex, pattern, buf, sizeof(buf));
+	if (errno)
+		/* patterns that don't compile have nothing to check */
+		return;
+	++npatterns;
+	if (text) {
+		check(&regex, pattern, text, len);
+		return;
+	}
+	static char texts[MAXTEXT];
+	for (size_t k = 0; k < NTEXTS; ++k) {
+		const size_t n = gentext(&regex, pattern, k, texts);
+		check(&regex, pattern, texts, n);
+	}
+}
+
+/* fuzzinput: splits an input into a pattern and a text at the first NUL, and fuzzes them */
+static void fuzzinput(const char* data, size_t size)
+{
+	static char pattern[MAXPATTERN];
+	const char* nul = memchr(data, '\0', size);
+	const size_t n = nul ? (size_t)(nul - data) : size;
+	if (n >= sizeof(pattern))
+		return;
+	memcpy(pattern, data, n);
+	pattern[n] = '\0';
+	if (nul)
+		fuzz(pattern, nul + 1, size - n - 1);
+	else
+		fuzz(pattern, NULL, 0);
+}
+
+#ifdef RE_FUZZ_LIBFUZZER
+int LLVMFuzzerTestOneInput(const unsigned char* data, size_t size)
+{
+	const size_t failed = nwrong + nslow - nknown;
+	fuzzinput((const char*)data, size);
+	/* the fuzzer only keeps an input that makes it crash */
+	if (nwrong + nslow - nknown != failed)
+		abort();
+	return 0;
+}
+#else
+int main(int argc, char** argv)
+{
+	size_t ngenerated = 100;
+	int nfiles = 0;
+	size_t nfast = 0; /* files given with -slow that weren't too slow */
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+			seed = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-patterns") == 0 && i + 1 < argc) {
+			ngenerated = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-steps") == 0 && i + 1 < argc) {
+			stepsperchar = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-ms") == 0 && i + 1 < argc) {
+			maxseconds = strtod(argv[++i], NULL) / 1000;
+		} else if (strcmp(argv[i], "-slow") == 0) {
+			expectslow = true;
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr, "usage: %s [-seed N] [-patterns N] [-steps N] [-ms N] [-slow] [FILE...]\n", argv[0]);
+			return 1;
+		} else {
+			FILE* file = fopen(argv[i], "rb");
+			if (!file) {
+				fprintf(stderr, "%s: can't open %s: %s\n", argv[0], argv[i], strerror(errno));
+				return 1;
+			}
+			static char data[MAXPATTERN + MAXTEXT];
+			const size_t size = fread(data, 1, sizeof(data), file);
+			fclose(file);
+			const size_t slow = nslow;
+			fuzzinput(data, size);
+			if (expectslow && nslow == slow) {
+				fprintf(stderr, "%s: no longer too slow.\n", argv[i]);
+				++nfast;
+			}
+			++nfiles;
+		}
+	}
+
+	if (!nfiles) {
+		for (size_t p = 0; p < ngenerated; ++p) {
+			char pattern[MAXPATTERN] = "";
+			genpattern(pattern, sizeof(pattern), 2);
+			fuzz(pattern, NULL, 0);
+		}
+	}
+
+	printf("%zu patterns, %zu texts, %zu wrong, %zu too slow (%zu of them known to be), %zu out of room; %.1f MB/s", npatterns, ntexts, nwrong, nslow, nknown, nfull, seconds > 0 ? chars / seconds / 1e6 : 0.0);
+	if (slowestlen)
+		printf(", slowest '%s' at %.1f ns/char on %zu chars", slowestpattern, slowest * 1e9, slowestlen);
+	printf(".\n");
+	/* AFL and scripts see the failures in the exit status */
+	if (expectslow)
+		return nwrong + nfast != 0;
+	return nwrong + nslow - nknown != 0;
+}
+#endif
@@ -4,6 +4,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "re.h"
 
 char buf[] =
@@ -2075,11 +2076,15 @@ int main()
 		const char old = buf[bufsizes[i]];
 		buf[bufsizes[i]] = 0;
 
-		printf("\tmatching on %lu bytes of test input\n", bufsizes[i]);
+		printf("\tmatching on %lu bytes of test input: ", bufsizes[i]);
 		fflush(stdout);
 		Regex re;
 		re_compile(&re, ".+nonexisting.+");
-		re_match(re, buf, NULL);
+		const clock_t start = clock();
+		re_matchp(&re, buf, NULL);
+		const double ms = (double)(clock() - start) * 1000 / CLOCKS_PER_SEC;
+		/* the time per byte should stay about the same as the input grows */
+		printf("%.3f ms (%.2f ns/byte)\n", ms, ms * 1e6 / bufsizes[i]);
 
 		buf[bufsizes[i]] = old;
 	}
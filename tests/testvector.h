@@ -0,0 +1,160 @@
+/*
+ * The patterns and texts of the fixed tests, shared by tests/fixed.c and tests/fixed.cpp.
+ *
+ * Each line is TEST(shouldsucceed, pattern, text); define TEST before including this file.
+ */
+
+TEST(false, "a",                        "")
+TEST(true , "a*",                       "")
+TEST(false, "[^s][^b]",                 "a")
+TEST(false, "[^\\d]+\\s",               "e")
+TEST(true , "\\d",                      "5")
+TEST(false, "\\d+",                     "y")
+TEST(true , "\\w+",                     "hej")
+TEST(true , "\\s",                      "\t \n")
+TEST(false, "\\S",                      "\t \n")
+TEST(true , "[\\s]",                    "\t \n")
+TEST(false, "[\\S]",                    "\t \n")
+TEST(false, "\\D",                      "5")
+TEST(false, "\\W+",                     "hej")
+TEST(true , "[0-9]+",                   "12345")
+TEST(true , "\\D",                      "hej")
+TEST(false, "\\d",                      "hej")
+TEST(true , "[^\\w]",                   "\\")
+TEST(true , "[\\W]",                    "\\")
+TEST(false, "[\\w]",                    "\\")
+TEST(true , "[^\\d]",                   "d")
+TEST(false, "[\\d]",                    "d")
+TEST(false, "[^\\D]",                   "d")
+TEST(true , "[\\D]",                    "d")
+TEST(true , "a+a",                      "aaa")
+TEST(true , "^.*\\\\.*$",               "c:\\Tools")
+TEST(true , "^[\\+-]*[\\d]+$",          "+27")
+TEST(true , "[abc]",                    "1c2")
+TEST(false, "[abc]",                    "1C2")
+TEST(true , "[1-5]+",                   "0123456789")
+TEST(true , "[.2]",                     "1C2")
+TEST(true , "a*$",                      "Xaa")
+TEST(true , "[a-h]+",                   "abcdefghxxx")
+TEST(false, "[a-h]+",                   "ABCDEFGH")
+TEST(true , "[A-H]+",                   "ABCDEFGH")
+TEST(false, "[A-H]+",                   "abcdefgh")
+TEST(true , "[^\\s]+",                  "abc def")
+TEST(true , "[^fc]+",                   "abc def")
+TEST(true , "[^d\\sf]+",                "abc def")
+TEST(true , "\n",                       "abc\ndef")
+TEST(true , "b.\\s*\n",                 "aa\r\nbb\r\ncc\r\n\r\n")
+TEST(true , ".*c",                      "abcabc")
+TEST(true , ".+c",                      "abcabc")
+TEST(true , "[b-z].*",                  "ab")
+TEST(true , "b[k-z]*",                  "ab")
+TEST(false, "[0-9]",                    "  - ")
+TEST(true , "[^0-9]",                   "  - ")
+TEST(true , "0|",                       "0|")
+TEST(false, "\\d\\d:\\d\\d:\\d\\d",     "0s:00:00")
+TEST(false, "\\d\\d:\\d\\d:\\d\\d",     "000:00")
+TEST(false, "\\d\\d:\\d\\d:\\d\\d",     "00:0000")
+TEST(false, "\\d\\d:\\d\\d:\\d\\d",     "100:0:00")
+TEST(false, "\\d\\d:\\d\\d:\\d\\d",     "00:100:00")
+TEST(false, "\\d\\d:\\d\\d:\\d\\d",     "0:00:100")
+TEST(true , "\\d\\d?:\\d\\d?:\\d\\d?",  "0:0:0")
+TEST(true , "\\d\\d?:\\d\\d?:\\d\\d?",  "0:00:0")
+TEST(true , "\\d\\d?:\\d\\d?:\\d\\d?",  "0:0:00")
+TEST(true , "\\d\\d?:\\d\\d?:\\d\\d?",  "00:0:0")
+TEST(true , "\\d\\d?:\\d\\d?:\\d\\d?",  "00:00:0")
+TEST(true , "\\d\\d?:\\d\\d?:\\d\\d?",  "00:0:00")
+TEST(true , "\\d\\d?:\\d\\d?:\\d\\d?",  "0:00:00")
+TEST(true , "\\d\\d?:\\d\\d?:\\d\\d?",  "00:00:00")
+TEST(true , "[Hh]ello [Ww]orld\\s*[!]?", "Hello world !")
+TEST(true , "[Hh]ello [Ww]orld\\s*[!]?", "hello world !")
+TEST(true , "[Hh]ello [Ww]orld\\s*[!]?", "Hello World !")
+TEST(true , "[Hh]ello [Ww]orld\\s*[!]?", "Hello world!   ")
+TEST(true , "[Hh]ello [Ww]orld\\s*[!]?", "Hello world    !")
+TEST(true , "[Hh]ello [Ww]orld\\s*[!]?", "hello World      !")
+TEST(false, "\\d\\d?:\\d\\d?:\\d\\d?",  "a:0")
+TEST(true , "[^\\w][^-1-4]",            ")T")
+TEST(true , "[^\\w][^-1-4]",            ")^")
+TEST(true , "[^\\w][^-1-4]",            "*)")
+TEST(true , "[^\\w][^-1-4]",            "!.")
+TEST(true , "[^\\w][^-1-4]",            " x")
+TEST(true , "[^\\w][^-1-4]",            "$b")
+TEST(true , ".?bar",                    "real_bar")
+TEST(false, ".?bar",                    "real_foo")
+TEST(false, "X?Y",                      "Z")
+TEST(true , "\\d+\\w?12",               "959312")
+TEST(true , "\\d+5",                    "12345")
+TEST(false, "\\d++5",                   "12345")
+TEST(false, "abcd",                     "aBcD")
+TEST(true , "(?i:abcd)",                "aBcD")
+TEST(false, "...",                      "\n \n")
+TEST(true , "(?s:...)",                 "\n \n")
+TEST(false, "(?s:(?-s:.))",             "\n")
+TEST(true , "(?is:A.)",                 "a\n")
+TEST(false, "(?is:(?-is:.g.))",         "\nG\n")
+TEST(true , "(?is:(?-is:.g.))",         "\ng\n")
+TEST(false, "(?i:a)b",                  "AB")
+TEST(true , "(?i:a)b",                  "Ab")
+TEST(false, "(?:(?i:a)c)?b",            "acB")
+TEST(false, "(?s:.).",                  "\n\n")
+TEST(false, "abc\\bdef",                "abcdef")
+TEST(true , "abc\\Bdef",                "abcdef")
+TEST(true , "\\Bing\\b",                "joining.")
+TEST(false, "\\Bing\\b",                " ing ")
+TEST(false, "\\Bing\\b",                "ing")
+TEST(false, "\\Bing\\b",                "bingg")
+TEST(true , "abc\\Rdef",                "abc\r\ndef")
+TEST(true , "abc\\Rdef",                "abc\ndef")
+TEST(false, "abc\n\\Rdef",              "abc\ndef")
+TEST(true , "abc\r\\Rdef",              "abc\r\ndef")
+TEST(true , "^(a+)a$",                  "aaa")
+TEST(true , "^a(a*)a$",                 "aa")
+TEST(true , "^(a)+a$",                  "aaa")
+TEST(true , "^(Hello){3}(World){1,2}$", "HelloHelloHelloWorld")
+TEST(true , "^(is:[ab])+?bc$",          "aAaAaaAAaaAAAAbAaaAbc")
+TEST(true , "(?=.*ghi)abc",             "abcdefghi")
+TEST(true , "(?s=.*END)BEGIN",          "BEGIN..content..\nEND")
+TEST(false, "(?s=.*END)BEGIN",          "BEGIN..content..\n")
+TEST(false, "(?s!.*END)BEGIN",          "BEGIN..content..\nEND")
+TEST(true , "(?s!.*END)BEGIN",          "BEGIN..content..\n")
+TEST(false, "(b*){1}+b",                "bbbbb")
+TEST(true , "((((((a))))))b",           "ab")
+TEST(false, "((((((a))))))b",           "aa")
+TEST(true , "(?i:hello)",               "say HeLLo")
+TEST(false, "(?i:hello)",               "say HeLL0")
+TEST(true , "^a\\.b",                   "a.bc")
+TEST(false, "^a\\.b",                   "xa.b")
+TEST(true , "c-d$",                     "c-dc-d")
+TEST(false, "c-d$",                     "c-d\n")
+TEST(false, "^abc$",                    "abcabc")
+TEST(true , "(?i:[A-C]+)",              "xbCa")
+TEST(false, "(?i:[^a-c])",              "BAC")
+TEST(false, "\\w",                      "\xe9")
+TEST(true , "\\w+@example\\.com",       "me@example.com")
+TEST(false, "\\w+@example\\.com",       "me@example.org")
+TEST(true , ".*ERROR.*",                "x: ERROR y")
+TEST(false, ".*ERROR.*",                "x: error y")
+TEST(true , "x?(?i:abcd)\\d",           "zABCD1")
+TEST(false, "x?(?i:abcd)\\d",           "zABCD ")
+TEST(true , "\\d{2}-abcd",              "1-12-abcd")
+TEST(false, "\\d{2}-abcd",              "1-2-abcd")
+TEST(true , "(?<=\\$)\\d+",             "cost: $15")
+TEST(false, "(?<=\\$)\\d+",             "cost: 15")
+TEST(false, "(?<!-)\\b\\d",             "-3")
+TEST(true , "(?<=a+)b",                 "aab")
+TEST(false, "(?<=a+)b",                 "b")
+TEST(false, "\\d{3}",                   "12")
+TEST(true , "(?i<=id=)\\d",             "ID=7")
+TEST(true , "\\d+$",                    "abc 123")
+TEST(false, "\\d+$",                    "123 abc")
+TEST(true , "(?:ab\\R)+$",              "ab\r\nab\n")
+/* a lookahead starts afresh each time, not with the count that a+ was left with when it failed before */
+TEST(false, "^(?:-(?!a+))+a$",           "--a")
+TEST(true , "^(?:-(?!a+))+-a$",          "--a")
+/* backtracking inside the lookahead mustn't undo the count that was set up for the lazy token after it */
+TEST(false, "(b*(?!^*?.)b*?)[xy]",      "b")
+TEST(true , "(b*(?!^*?a)b*?)[xy]",      "bx")
+/* too large for the Regex itself */
+TEST(true , "abcdefghijklmnopqrstuvwxyz0123456789", "..abcdefghijklmnopqrstuvwxyz0123456789..")
+TEST(false, "abcdefghijklmnopqrstuvwxyz0123456789", "..abcdefghijklmnopqrstuvwxyz012345678..")
+TEST(true , "[abcdefghijklmnopqrstuvwxyz]+!", "hello!")
+TEST(false, "[abcdefghijklmnopqrstuvwxyz]+!", "hello?")